@@ -66,6 +66,7 @@ enum tmf882x_msg_id {
   ID_MEAS_RESULTS    = 0x01,
   ID_MEAS_STATS      = 0x02,
   ID_HISTOGRAM       = 0x03,
+  ID_STATUS          = 0x04,
   ID_ERROR           = 0x0F,
 };
 
@@ -89,6 +90,14 @@ enum tmf882x_msg_error_codes {
   ERR_BUF_OVERFLOW    = 0xFF,
 };
 
+/**
+ * @enum tmf882x_msg_status_codes
+ * @brief Status message type identifier codes
+ */
+enum tmf882x_msg_status_codes {
+  STATUS_HIST_DECIMATION = 0x01,
+};
+
 /* Output buffer is (HEADER_SIZE)+(DATA_SET_SIZE) to account for framing
  * before sending up the data out of the driver
  *
@@ -161,6 +170,27 @@ struct tmf882x_msg_header {
 };
 #define TMF882X_MSG_HEADER_SIZE  sizeof(struct tmf882x_msg_header)
 
+/**
+ * @brief Size of the message timestamp
+ *      Open files that set @ref TMF882X_MSG_FLAG_TIMESTAMP receive every
+ *      message followed by the uint64_t CLOCK_BOOTTIME timestamp (in
+ *      nanoseconds) of the device interrupt that produced it, 'msg_len'
+ *      includes the timestamp. Messages that are not produced by an interrupt
+ *      carry the time they were published. The timestamp is not 8-byte
+ *      aligned, use @ref TMF882X_MSG_TIMESTAMP to read it.
+ */
+#define TMF882X_MSG_TIMESTAMP_SIZE  sizeof(uint64_t)
+
+#define TMF882X_MSG_TIMESTAMP(msg) \
+({ \
+    const struct tmf882x_msg_header *__h = \
+        (const struct tmf882x_msg_header *)(msg); \
+    uint64_t __ts; \
+    memcpy(&__ts, (const uint8_t *)__h + __h->msg_len - \
+           TMF882X_MSG_TIMESTAMP_SIZE, sizeof(__ts)); \
+    __ts; \
+})
+
 /**
  * @struct tmf882x_msg_error
  * @brief TMF882X error message type.
@@ -176,6 +206,27 @@ struct tmf882x_msg_error {
     uint32_t err_code;
 };
 
+/**
+ * @struct tmf882x_msg_status
+ * @brief TMF882X status message type.
+ *      This message is returned by the driver to notify readers of a change
+ *      in the way messages are published.
+ * @var tmf882x_msg_status::hdr
+ *      This is the status message header @ref struct tmf882x_msg_header
+ * @var tmf882x_msg_status::status_code
+ *      This is the status code identifier
+ *      @ref enum tmf882x_msg_status_codes
+ * @var tmf882x_msg_status::value
+ *      This is the status value. For @ref STATUS_HIST_DECIMATION this is the
+ *      histogram decimation factor, only every Nth capture publishes its
+ *      histograms. A value of zero means every histogram is published.
+ */
+struct tmf882x_msg_status {
+    struct tmf882x_msg_header hdr;
+    uint32_t status_code;
+    uint32_t value;
+};
+
 /**
  * @struct tmf882x_msg_histogram
  * @brief TMF882X histogram message type.
@@ -333,6 +384,8 @@ struct tmf882x_msg_meas_stats {
  *      This is the message header @ref struct tmf882x_msg_header
  * @var tmf882x_msg::err_msg
  *      This is the error message @ref struct tmf882x_msg_error
+ * @var tmf882x_msg::status_msg
+ *      This is the status message @ref struct tmf882x_msg_status
  * @var tmf882x_msg::hist_msg
  *      This is the histogram message @ref struct tmf882x_msg_histogram
  * @var tmf882x_msg::meas_result_msg
@@ -346,6 +399,7 @@ struct tmf882x_msg {
     union {
         struct tmf882x_msg_header       hdr;
         struct tmf882x_msg_error        err_msg;
+        struct tmf882x_msg_status       status_msg;
         struct tmf882x_msg_histogram    hist_msg;
         struct tmf882x_msg_meas_results meas_result_msg;
         struct tmf882x_msg_meas_stats   meas_stat_msg;
@@ -383,6 +437,14 @@ struct tmf882x_msg {
     __m->err_msg.err_code = errid; \
  })
 
+#define TOF_SET_STATUS_MSG(msg, code, val) \
+({ \
+    struct tmf882x_msg *__m = (struct tmf882x_msg *)(msg); \
+    TOF_SET_MSG_HDR(msg, ID_STATUS, struct tmf882x_msg_status); \
+    __m->status_msg.status_code = code; \
+    __m->status_msg.value = val; \
+ })
+
 #define TOF_SET_HISTOGRAM_MSG(msg, hist_type) \
 ({ \
     struct tmf882x_msg *__m = (struct tmf882x_msg *)(msg); \
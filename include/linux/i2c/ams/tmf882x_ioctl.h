@@ -35,6 +35,98 @@
 #define TMF882X_IOC_BASE       (0)
 #define TMF882X_IOCFIFOFLUSH    _IO(TMF882X_IOC_MAG, TMF882X_IOC_BASE + 0)
 #define TMF882X_IOCAPPRESET     _IO(TMF882X_IOC_MAG, TMF882X_IOC_BASE + 1)
-#define TMF882X_IOC_MAXNR       (2)
+#define TMF882X_IOCSETMSGMASK   _IOW(TMF882X_IOC_MAG, TMF882X_IOC_BASE + 2, __u32)
+#define TMF882X_IOCGETMSGMASK   _IOR(TMF882X_IOC_MAG, TMF882X_IOC_BASE + 3, __u32)
+#define TMF882X_IOCGETDROPPED   _IOR(TMF882X_IOC_MAG, TMF882X_IOC_BASE + 4, __u32)
+#define TMF882X_IOCSETWATERMARK _IOW(TMF882X_IOC_MAG, TMF882X_IOC_BASE + 5, \
+                                     struct tmf882x_watermark)
+#define TMF882X_IOCGETWATERMARK _IOR(TMF882X_IOC_MAG, TMF882X_IOC_BASE + 6, \
+                                     struct tmf882x_watermark)
+#define TMF882X_IOCREADBATCH    _IOWR(TMF882X_IOC_MAG, TMF882X_IOC_BASE + 7, \
+                                      struct tmf882x_read_batch)
+#define TMF882X_IOCSETMSGFLAGS  _IOW(TMF882X_IOC_MAG, TMF882X_IOC_BASE + 8, __u32)
+#define TMF882X_IOCGETMSGFLAGS  _IOR(TMF882X_IOC_MAG, TMF882X_IOC_BASE + 9, __u32)
+#define TMF882X_IOC_MAXNR       (10)
+
+/*
+ * Per-open-file low-watermark for poll() and blocking read().
+ *
+ * The char device only reports readable once 'msg_count' messages or 'bytes'
+ * bytes are queued (whichever is set and met first), or once 'timeout_ms'
+ * elapsed since the first message was queued. All zero (the default) reports
+ * readable as soon as one message is queued.
+ */
+struct tmf882x_watermark {
+    __u32 msg_count;
+    __u32 bytes;
+    __u32 timeout_ms;
+};
+
+/*
+ * Batched read of whole messages with explicit message boundaries.
+ *
+ * Up to 'max_frames' messages are copied back-to-back into the user buffer
+ * 'buf' of 'buf_len' bytes, and one struct tmf882x_frame_desc per message is
+ * written to the user array 'descs'. The call blocks until at least
+ * 'min_frames' messages are queued or 'timeout_ms' expires (< 0 waits
+ * forever, 0 never blocks), then returns whatever is available.
+ * 'num_frames' and 'bytes' return the number of messages and bytes copied.
+ */
+struct tmf882x_frame_desc {
+    __u32 offset;
+    __u32 len;
+    __u32 msg_id;
+};
+
+struct tmf882x_read_batch {
+    __u64 descs;
+    __u64 buf;
+    __u32 max_frames;
+    __u32 buf_len;
+    __u32 min_frames;
+    __s32 timeout_ms;
+    __u32 num_frames;
+    __u32 bytes;
+};
+
+/*
+ * Per-open-file message format flags, all clear by default.
+ *
+ * TMF882X_MSG_FLAG_TIMESTAMP appends the timestamp of the device interrupt to
+ * every message queued after the flag is set, see TMF882X_MSG_TIMESTAMP_SIZE.
+ */
+#define TMF882X_MSG_FLAG_TIMESTAMP  (1U << 0)
+#define TMF882X_MSG_FLAGS_ALL       (TMF882X_MSG_FLAG_TIMESTAMP)
+
+/* Message subscription mask bit of an 'enum tmf882x_msg_id' value */
+#define TMF882X_MSG_MASK(id)    (1U << (id))
+#define TMF882X_MSG_MASK_ALL    (0xFFFFFFFF)
+
+/*
+ * Frame ring shared with userspace through mmap() of the ToF char device.
+ *
+ * The mapping starts with a control block (struct tmf882x_ring_ctrl), frame
+ * slots start at 'data_offset'. Every slot is 'slot_size' bytes long and holds
+ * exactly one message (struct tmf882x_msg). The number of slots is derived
+ * from the length passed to mmap(), at least TMF882X_RING_MIN_SLOTS must fit.
+ *
+ * 'head' is written only by the driver, 'tail' only by userspace. Both are
+ * free-running counters, the slot of a counter is (counter % num_slots).
+ * The ring is empty when head == tail, and full when (head - tail) equals
+ * 'num_slots', in which case new messages are dropped and 'dropped' is
+ * incremented.
+ */
+#define TMF882X_RING_MAGIC      (0x544F4652) /* 'TOFR' */
+#define TMF882X_RING_MIN_SLOTS  (2)
+
+struct tmf882x_ring_ctrl {
+    __u32 magic;
+    __u32 slot_size;
+    __u32 num_slots;
+    __u32 data_offset;
+    __u32 head;
+    __u32 tail;
+    __u32 dropped;
+};
 
 #endif
@@ -0,0 +1,17 @@
+#!/bin/bash -e
+
+# Build and run the userspace firmware download benchmark on the host.
+# Usage: fwdl_bench.sh [benchmark options] [firmware.hex], see -h
+
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" >/dev/null && pwd )"
+BENCH_OUT="$DIR/fwdl_bench/fwdl_bench"
+
+echo "****************"
+echo "Compiling benchmark"
+${HOSTCC:-cc} -O2 -Wall \
+    -I "$DIR/fwdl_bench/include" -I "$DIR/../include" \
+    -o "$BENCH_OUT" "$DIR/fwdl_bench/fwdl_bench.c"
+
+echo "****************"
+echo "Running benchmark"
+"$BENCH_OUT" "$@"
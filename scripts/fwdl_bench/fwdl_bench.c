@@ -0,0 +1,355 @@
+/*
+ * Userspace benchmark of the firmware download paths of the bootloader mode
+ *
+ * The platform-agnostic core (intel_hex_interpreter.c, tmf882x_mode.c and
+ * tmf882x_mode_bl.c) is compiled as-is against a small userspace shim with a
+ * fake I2C bus. The fake bootloader completes every command on the first
+ * status poll, so the numbers are the host side cost of each path:
+ *
+ *  - HEX: the Intel HEX image is parsed while it is downloaded
+ *  - SEG: the image is converted once (the driver's firmware cache), the
+ *         download then only walks the segments
+ *  - BIN: the same bytes as one flat binary, the lower bound for a download
+ *
+ * For each path the CPU time per download, the number of I2C transactions,
+ * the bytes on the bus and an estimate of the bus time at the given SCL
+ * clock are reported. See fwdl_bench.sh for how to build and run it.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/module.h>
+
+/* keep the kernel shim out, the definitions below take its place */
+#define __TMF882X_HOST_INTERFACE_H
+
+struct timespec64 {
+    int64_t tv_sec;
+    long tv_nsec;
+};
+
+struct tof_sensor_chip {
+    uint32_t xfers;
+    uint64_t bus_bits;
+    uint8_t regs[256];
+};
+
+static int fwdl_bench_verbose;
+
+#define tof_err(p, fmt, ...) \
+    fprintf(stderr, "err: " fmt "\n", ##__VA_ARGS__)
+
+#define tof_info(p, fmt, ...) \
+({ \
+    if (fwdl_bench_verbose) \
+        fprintf(stderr, fmt "\n", ##__VA_ARGS__); \
+})
+
+#define tof_dbg(p, fmt, ...) \
+({ \
+    if (fwdl_bench_verbose > 1) \
+        fprintf(stderr, fmt "\n", ##__VA_ARGS__); \
+})
+
+/* START, address and register byte, data bytes and STOP, 9 bits per byte */
+#define BUS_BITS_WRITE(len)   (2 + 9 * (2 + (uint64_t)(len)))
+/* a read adds a repeated START and the address byte again */
+#define BUS_BITS_READ(len)    (1 + 9 + BUS_BITS_WRITE(len))
+
+static inline int32_t tof_i2c_read(struct tof_sensor_chip *chip, uint8_t reg,
+                                   uint8_t *buf, int32_t len)
+{
+    chip->xfers++;
+    chip->bus_bits += BUS_BITS_READ(len);
+    memset(buf, 0, len);
+    /* bootloader CMD_STAT: ready, no data, valid checksum */
+    if (reg == 0x08 && len >= 3)
+        buf[2] = 0xFF;
+    return 0;
+}
+
+static inline int32_t tof_i2c_write(struct tof_sensor_chip *chip, uint8_t reg,
+                                    const uint8_t *buf, int32_t len)
+{
+    chip->xfers++;
+    chip->bus_bits += BUS_BITS_WRITE(len);
+    if (reg + len <= (int32_t)sizeof(chip->regs))
+        memcpy(&chip->regs[reg], buf, len);
+    return 0;
+}
+
+static inline int32_t tof_set_register(struct tof_sensor_chip *chip, uint8_t reg,
+                                       uint8_t val)
+{
+    return tof_i2c_write(chip, reg, &val, 1);
+}
+
+static inline int32_t tof_get_register(struct tof_sensor_chip *chip, uint8_t reg,
+                                       uint8_t *val)
+{
+    return tof_i2c_read(chip, reg, val, 1);
+}
+
+static inline void tof_regcache_drop(struct tof_sensor_chip *chip)
+{
+    (void)chip;
+}
+
+static inline void tof_usleep(struct tof_sensor_chip *chip, uint32_t usec)
+{
+    (void)chip;
+    (void)usec;
+}
+
+#include "../../intel_hex_interpreter.c"
+#include "../../tmf882x_mode.c"
+#include "../../tmf882x_mode_bl.c"
+
+#define BENCH_DEF_ITERS      200
+#define BENCH_DEF_SCL_HZ     1000000
+#define BENCH_DEF_IMAGE_SZ   (32 * 1024)
+#define BENCH_DEF_REC_SZ     16
+
+struct bench_result {
+    const char *name;
+    double cpu_us;
+    uint32_t xfers;
+    uint64_t bus_bits;
+    int32_t rc;
+};
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void bench_fwdl(struct bench_result *res, const char *name,
+                       int32_t fwdl_type, const uint8_t *buf, size_t len,
+                       int iters)
+{
+    struct tof_sensor_chip chip;
+    struct tmf882x_mode_bl bl;
+    double start;
+    int i;
+
+    res->name = name;
+    res->rc = 0;
+    start = now_us();
+    for (i = 0; i < iters && !res->rc; i++) {
+        memset(&chip, 0, sizeof(chip));
+        memset(&bl, 0, sizeof(bl));
+        tmf882x_mode_bl_init(&bl, &chip);
+        res->rc = bl.mode.ops->fwdl(&bl.mode, fwdl_type, buf, len);
+    }
+    res->cpu_us = (now_us() - start) / iters;
+    res->xfers = chip.xfers;
+    res->bus_bits = chip.bus_bits;
+}
+
+static void print_result(const struct bench_result *res, uint32_t scl_hz)
+{
+    if (res->rc) {
+        printf("%-4s  download failed: %d\n", res->name, res->rc);
+        return;
+    }
+    printf("%-4s  %10.1f  %8u  %10llu  %10.1f\n", res->name, res->cpu_us,
+           res->xfers, (unsigned long long)(res->bus_bits / 9),
+           res->bus_bits * 1e3 / scl_hz);
+}
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t *buf = NULL;
+    long size;
+
+    if (!f)
+        return NULL;
+    if (!fseek(f, 0, SEEK_END) && (size = ftell(f)) > 0 &&
+        !fseek(f, 0, SEEK_SET)) {
+        buf = malloc(size);
+        if (buf && fread(buf, 1, size, f) != (size_t)size) {
+            free(buf);
+            buf = NULL;
+        }
+        *len = size;
+    }
+    fclose(f);
+    return buf;
+}
+
+static size_t hex_record(char *out, uint8_t type, uint16_t addr,
+                         const uint8_t *data, uint8_t len)
+{
+    uint8_t sum = len + (addr >> 8) + (addr & 0xFF) + type;
+    size_t n = sprintf(out, ":%02X%04X%02X", len, addr, type);
+    uint8_t i;
+
+    for (i = 0; i < len; i++) {
+        n += sprintf(&out[n], "%02X", data[i]);
+        sum += data[i];
+    }
+    n += sprintf(&out[n], "%02X\r\n", (uint8_t)-sum);
+    return n;
+}
+
+/* pseudo-random image at the bootloader's default load address */
+static uint8_t *make_hex(size_t image_sz, uint8_t rec_sz, size_t *len)
+{
+    size_t max = (image_sz / rec_sz + 8) * (16 + 2 * rec_sz);
+    char *hex = malloc(max);
+    uint32_t addr = BL_DEFAULT_BIN_START_ADDR;
+    uint32_t lfsr = 0xACE1u;
+    uint8_t data[255];
+    size_t off = 0;
+    size_t done;
+    uint8_t i;
+
+    if (!hex)
+        return NULL;
+    for (done = 0; done < image_sz; done += rec_sz, addr += rec_sz) {
+        if (!done || !(addr & 0xFFFF)) {
+            data[0] = addr >> 24;
+            data[1] = addr >> 16;
+            off += hex_record(&hex[off], 0x04, 0, data, 2);
+        }
+        if (rec_sz > image_sz - done)
+            rec_sz = image_sz - done;
+        for (i = 0; i < rec_sz; i++) {
+            lfsr = lfsr * 1103515245u + 12345u;
+            data[i] = lfsr >> 16;
+        }
+        off += hex_record(&hex[off], 0x00, addr & 0xFFFF, data, rec_sz);
+    }
+    off += hex_record(&hex[off], 0x01, 0, NULL, 0);
+    *len = off;
+    return (uint8_t *)hex;
+}
+
+/* flatten the segments into one image, gaps are zero-filled */
+static uint8_t *seg_to_bin(const uint8_t *seg, size_t seg_len, size_t *len)
+{
+    const struct tmf882x_fw_seg *hdr;
+    uint8_t *bin = NULL;
+    uint32_t end = BL_DEFAULT_BIN_START_ADDR;
+    size_t off;
+
+    for (off = 0; off < seg_len; off += BL_SEG_SIZE(hdr->len)) {
+        hdr = (const struct tmf882x_fw_seg *)&seg[off];
+        if (hdr->addr < BL_DEFAULT_BIN_START_ADDR)
+            return NULL;
+        if (hdr->addr + hdr->len > end)
+            end = hdr->addr + hdr->len;
+    }
+    *len = end - BL_DEFAULT_BIN_START_ADDR;
+    bin = calloc(1, *len);
+    if (!bin)
+        return NULL;
+    for (off = 0; off < seg_len; off += BL_SEG_SIZE(hdr->len)) {
+        hdr = (const struct tmf882x_fw_seg *)&seg[off];
+        memcpy(&bin[hdr->addr - BL_DEFAULT_BIN_START_ADDR], hdr + 1,
+               hdr->len);
+    }
+    return bin;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-n iterations] [-c scl_hz] [-s image_size] "
+            "[-r record_size] [-v] [firmware.hex]\n"
+            "Without a HEX file, a synthetic image of image_size bytes in "
+            "record_size byte records is used.\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_result res[3];
+    uint8_t *hex, *seg, *bin = NULL;
+    size_t hex_len, bin_len = 0;
+    size_t image_sz = BENCH_DEF_IMAGE_SZ;
+    uint32_t scl_hz = BENCH_DEF_SCL_HZ;
+    uint32_t num_seg = 0;
+    int rec_sz = BENCH_DEF_REC_SZ;
+    int iters = BENCH_DEF_ITERS;
+    int32_t seg_len;
+    double start, conv_us;
+    size_t off;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "n:c:s:r:vh")) != -1) {
+        switch (opt) {
+        case 'n': iters = atoi(optarg); break;
+        case 'c': scl_hz = strtoul(optarg, NULL, 0); break;
+        case 's': image_sz = strtoul(optarg, NULL, 0); break;
+        case 'r': rec_sz = atoi(optarg); break;
+        case 'v': fwdl_bench_verbose++; break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : EINVAL;
+        }
+    }
+    if (iters <= 0 || !scl_hz || !image_sz || rec_sz <= 0 || rec_sz > 255) {
+        usage(argv[0]);
+        return EINVAL;
+    }
+
+    if (optind < argc) {
+        hex = read_file(argv[optind], &hex_len);
+        if (!hex) {
+            fprintf(stderr, "Can not read '%s'\n", argv[optind]);
+            return ENOENT;
+        }
+        printf("image: %s, %zu B of HEX\n", argv[optind], hex_len);
+    } else {
+        hex = make_hex(image_sz, rec_sz, &hex_len);
+        if (!hex)
+            return ENOMEM;
+        printf("image: synthetic, %zu B in %d B records, %zu B of HEX\n",
+               image_sz, rec_sz, hex_len);
+    }
+
+    /* the firmware cache conversion, paid once per firmware file */
+    seg_len = tmf882x_mode_bl_hex_to_seg(hex, hex_len, NULL, 0);
+    if (seg_len <= 0) {
+        fprintf(stderr, "Invalid or partial HEX image: %d\n", seg_len);
+        return EINVAL;
+    }
+    seg = malloc(seg_len);
+    if (!seg)
+        return ENOMEM;
+    start = now_us();
+    for (i = 0; i < iters; i++) {
+        if (tmf882x_mode_bl_hex_to_seg(hex, hex_len, NULL, 0) != seg_len ||
+            tmf882x_mode_bl_hex_to_seg(hex, hex_len, seg, seg_len) != seg_len) {
+            fprintf(stderr, "HEX conversion failed\n");
+            return EINVAL;
+        }
+    }
+    conv_us = (now_us() - start) / iters;
+    for (off = 0; off < (size_t)seg_len; num_seg++)
+        off += BL_SEG_SIZE(((struct tmf882x_fw_seg *)&seg[off])->len);
+    printf("cache: %d B in %u segments, conversion %.1f us\n\n",
+           seg_len, num_seg, conv_us);
+
+    bench_fwdl(&res[0], "HEX", FWDL_TYPE_HEX, hex, hex_len, iters);
+    bench_fwdl(&res[1], "SEG", FWDL_TYPE_SEG, seg, seg_len, iters);
+    bin = seg_to_bin(seg, seg_len, &bin_len);
+    if (bin)
+        bench_fwdl(&res[2], "BIN", FWDL_TYPE_BIN, bin, bin_len, iters);
+
+    printf("path  cpu us/dl  i2c xfers  bus bytes  bus ms @ %u Hz\n", scl_hz);
+    for (i = 0; i < (bin ? 3 : 2); i++)
+        print_result(&res[i], scl_hz);
+    if (!bin)
+        printf("BIN   n/a, image starts below %#x\n", BL_DEFAULT_BIN_START_ADDR);
+
+    free(bin);
+    free(seg);
+    free(hex);
+    return (res[0].rc || res[1].rc || (bin && res[2].rc)) ? EIO : 0;
+}
@@ -0,0 +1,13 @@
+/*
+ * Userspace stand-in for <linux/module.h>, see ../../fwdl_bench.c
+ */
+#ifndef __FWDL_BENCH_LINUX_MODULE_H
+#define __FWDL_BENCH_LINUX_MODULE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+
+#endif
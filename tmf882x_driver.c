@@ -44,8 +44,19 @@
 #include <linux/platform_device.h>
 #include <linux/gpio/consumer.h>
 #include <linux/kfifo.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/kthread.h>
+#include <linux/regmap.h>
+#include <linux/cpumask.h>
 #include <linux/input.h>
 #include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
 #include <linux/uaccess.h>
 #include <linux/poll.h>
 #include <linux/eventpoll.h>
@@ -61,6 +72,7 @@
 #define TOF_GPIO_INT_NAME           "irq"
 #define TOF_GPIO_ENABLE_NAME        "enable"
 #define TOF_PROP_NAME_POLLIO        "poll_period"
+#define TOF_PROP_NAME_FIFO_SIZE     "fifo_size"
 #define TMF882X_DEFAULT_INTERVAL_MS 10
 
 #define AMS_MUTEX_LOCK(m) { \
@@ -75,6 +87,57 @@
 
 #define TMF_DEFAULT_I2C_ADDR 0x41
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,2,0)
+#define timer_delete            del_timer
+#define timer_delete_sync       del_timer_sync
+#endif
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,16,0)
+#define timer_container_of      from_timer
+#endif
+
+#define TOF_FIFO_SIZE        (4*PAGE_SIZE)
+#define TOF_FIFO_MIN_SIZE    (roundup_pow_of_two(sizeof(struct tmf882x_msg)))
+#define TOF_FIFO_MAX_SIZE    (4*1024*1024)
+
+#define TOF_HIST_DECIMATION_DEF     1   /* off, opt-in through sysfs */
+#define TOF_HIST_HIGH_WATER_DEF     75  /* percent of the bulk lane */
+#define TOF_HIST_LOW_WATER_DEF      25  /* percent of the bulk lane */
+#define TOF_REGMAP_MAX_REG          0xFF
+#define TOF_I2C_WBUF_SIZE           (1 + 256) /* register byte + full map */
+#define TOF_SYS_TICK_NS             200 /* device sys_tick runs at 5 MHz */
+#define TOF_POLL_MAX_REJECTS        4   /* frame period resync threshold */
+#define TOF_POLL_LOCK_FRAMES        4   /* frames without result until unlocked */
+#define TOF_POLL_CREEP_DIV          8   /* phase creep, fraction of poll period */
+#define TOF_POLL_SLACK_NS           (20 * NSEC_PER_USEC)
+#define TOF_FW_VER_LEN              4   /* app id, minor, build, patch */
+#define TOF_RING_RESULT_RESERVE     4   /* 1/4 of the ring is kept for results */
+#define TOF_RING_MAX_SIZE           (PAGE_SIZE + TOF_FIFO_MAX_SIZE)
+
+/* Reader FIFO overflow policies, see sysfs 'overflow_policy' */
+enum tof_overflow_policy {
+    TOF_OVERFLOW_FLUSH       = 0,
+    TOF_OVERFLOW_DROP_OLDEST = 1,
+    TOF_OVERFLOW_DROP_NEWEST = 2,
+    TOF_NUM_OVERFLOW_POLICIES
+};
+
+/* Reader FIFO lanes, the result lane is always drained first by read() */
+enum tof_fifo_lane_id {
+    TOF_LANE_RESULT = 0,    /* measurement results and errors */
+    TOF_LANE_BULK   = 1,    /* histograms and measurement statistics */
+    TOF_NUM_LANES
+};
+
+static unsigned int fifo_size;
+module_param(fifo_size, uint, 0444);
+MODULE_PARM_DESC(fifo_size, "Bulk output FIFO size per reader in bytes, "
+                 "overrides the '" TOF_PROP_NAME_FIFO_SIZE "' DT property");
+
+static int decode_cpu = -1;
+module_param(decode_cpu, int, 0444);
+MODULE_PARM_DESC(decode_cpu, "CPU the data message decode worker is bound to, "
+                 "-1 lets the scheduler pick any CPU (default)");
+
 struct tmf882x_platform_data {
     const char *tof_name;
     struct gpio_desc *gpiod_interrupt;
@@ -84,25 +147,116 @@ struct tmf882x_platform_data {
     const char *ram_patch_fname[];
 };
 
+struct tof_sensor_chip;
+struct tof_reader;
+
+/* mmap()-able frame ring, layout is described by struct tmf882x_ring_ctrl */
+struct tof_frame_ring {
+    struct tof_reader *reader;
+    struct tmf882x_ring_ctrl *ctrl;
+    u8 *slots;
+    u32 slot_size;
+    u32 num_slots;
+    u32 head;
+    u32 dropped;
+    atomic_t map_count;
+};
+
+struct tof_fifo_lane {
+    void *buf;
+    u32 msg_count;
+    u32 out_seq;    /* counts messages removed from the lane */
+    DECLARE_KFIFO_PTR(fifo, u8);
+};
+
+/* Per-open-file state of the ToF char device, every reader sees every frame.
+ * The lanes are protected by the 'fifo_lock' spinlock, which is only held for
+ * the FIFO index updates and never across a copy to userspace. Readers peek a
+ * message into a bounce buffer, copy it out with only 'read_lock' held, and
+ * then remove it unless the producer dropped it meanwhile. A faulting reader
+ * so never stalls the IRQ thread. Lock order is chip->lock, then fifo_lock.
+ */
+struct tof_reader {
+    struct list_head node;
+    struct tof_sensor_chip *chip;
+    struct tof_frame_ring *ring;
+    spinlock_t fifo_lock;
+    struct mutex read_lock; /* serializes read() and batched reads */
+    u32 msg_mask;
+    u32 msg_flags;
+    u32 dropped;
+    struct tmf882x_watermark wm;
+    struct timer_list wm_timer;
+    bool wm_expired;
+    struct tof_fifo_lane lanes[TOF_NUM_LANES];
+};
+
+/* Phase-locked polling state, see tmf882x_poll_irq_thread().
+ * The poll is scheduled just after the predicted result-ready time, which is
+ * learned from the device sys_ticks of consecutive measurement results.
+ */
+struct tof_poll_pll {
+    u64 frame_ns;       /* learned frame period, 0 while unknown */
+    u64 last_hit_ns;    /* time of the poll that read the last result */
+    u32 last_sys_ticks; /* device sys_ticks of the last result */
+    u32 rejects;        /* consecutive frame period samples rejected */
+    u32 polls;          /* number of polls */
+    u32 hits;           /* polls that read out a measurement result */
+    u32 early;          /* polls before the result was ready, while locked */
+    bool hit;           /* the current poll read out a measurement result */
+    bool frame_early;   /* the current frame had at least one early poll */
+};
+
 struct tof_sensor_chip {
 
     bool driver_remove;
     bool fwdl_needed;
+    u64 fwdl_time_us;
+    bool fwdl_busy;
+    int fwdl_result;
     int poll_period;
     int open_refcnt;
     int driver_debug;
+    unsigned int fifo_size[TOF_NUM_LANES];
+    int overflow_policy;
+    u32 hist_decimation;
+    u32 hist_high_water;
+    u32 hist_low_water;
+    bool hist_decimating;
+    bool wake_pending;
+    u64 irq_timestamp_ns;
+    struct tof_poll_pll poll;
 
     /* Linux kernel structure(s) */
-    DECLARE_KFIFO(fifo_out, u8, 4*PAGE_SIZE);
+    struct list_head readers;
     struct mutex lock;
     struct miscdevice tof_mdev;
     struct input_dev *tof_idev;
-    struct completion ram_patch_in_progress;
-    struct firmware *tof_fw;
+    struct work_struct fwdl_work;
+    struct completion fwdl_done;
+    struct completion cmd_done;
+    bool cmd_irq_armed;
+    bool irq_thread_pending;
+    struct kthread_worker *decode_worker;
+    struct kthread_work decode_work;
+    struct completion decode_done;
+    bool decoding;
+    u8 *fw_cache;
+    size_t fw_cache_size;
+    u32 fw_cache_crc;
+    /* fingerprint of the image last patched into the device RAM */
+    bool fw_app_valid;
+    u32 fw_app_crc;
+    u8 fw_app_ver[TOF_FW_VER_LEN];
     struct tmf882x_platform_data *pdata;
     struct i2c_client *client;
+    bool i2c_nostart;
+    struct mutex i2c_wbuf_lock;
+    u8 *i2c_wbuf;
+    struct regmap *regmap;
     struct task_struct *poll_irq;
     wait_queue_head_t fifo_wait;
+    spinlock_t ring_lock;
 
 #ifdef CONFIG_TMF882X_QCOM_AP
     // Qualcomm linux kernel AP structures
@@ -158,7 +312,7 @@ inline struct device * tof_to_dev(struct tof_sensor_chip *chip)
  * Function Declarations
  *
  */
-static void tof_ram_patch_callback(const struct firmware *cfg, void *ctx);
+static int tof_ram_patch(struct tof_sensor_chip *chip);
 static irqreturn_t tof_irq_handler(int irq, void *dev_id);
 static int tof_hard_reset(struct tof_sensor_chip *chip);
 static int tof_frwk_i2c_write_mask(struct tof_sensor_chip *chip, char reg,
@@ -167,18 +321,81 @@ static int tof_poweroff_device(struct tof_sensor_chip *chip);
 static int tof_poweron_device(struct tof_sensor_chip *chip);
 static int tof_open_mode(struct tof_sensor_chip *chip, uint32_t req_mode);
 
-static size_t tof_fifo_next_msg_size(struct tof_sensor_chip *chip)
+static enum tof_fifo_lane_id tof_msg_lane(struct tmf882x_msg *msg)
+{
+    switch (msg->hdr.msg_id) {
+        case ID_HISTOGRAM:
+        case ID_MEAS_STATS:
+            return TOF_LANE_BULK;
+        default:
+            return TOF_LANE_RESULT;
+    }
+}
+
+static size_t tof_lane_next_msg_size(struct tof_fifo_lane *lane)
 {
     struct tmf882x_msg_header hdr;
     int ret;
-    if (kfifo_is_empty(&chip->fifo_out))
+    if (kfifo_is_empty(&lane->fifo))
         return 0;
-    ret = kfifo_out_peek(&chip->fifo_out, (char *)&hdr, sizeof(hdr));
+    ret = kfifo_out_peek(&lane->fifo, (char *)&hdr, sizeof(hdr));
     if (ret != sizeof(hdr))
         return 0;
     return hdr.msg_len;
 }
 
+static void tof_lane_reset(struct tof_fifo_lane *lane)
+{
+    kfifo_reset(&lane->fifo);
+    lane->out_seq += lane->msg_count;
+    lane->msg_count = 0;
+}
+
+/* Next lane to read from, NULL if all lanes are empty */
+static struct tof_fifo_lane *tof_reader_next_lane(struct tof_reader *reader)
+{
+    int i;
+    for (i = 0; i < TOF_NUM_LANES; i++) {
+        if (!kfifo_is_empty(&reader->lanes[i].fifo))
+            return &reader->lanes[i];
+    }
+    return NULL;
+}
+
+static bool tof_reader_fifo_is_empty(struct tof_reader *reader)
+{
+    return !tof_reader_next_lane(reader);
+}
+
+static size_t tof_fifo_next_msg_size(struct tof_reader *reader)
+{
+    struct tof_fifo_lane *lane = tof_reader_next_lane(reader);
+    return lane ? tof_lane_next_msg_size(lane) : 0;
+}
+
+static void tof_reader_fifo_reset(struct tof_reader *reader)
+{
+    int i;
+    for (i = 0; i < TOF_NUM_LANES; i++)
+        tof_lane_reset(&reader->lanes[i]);
+}
+
+/**
+ * tof_fifo_flush - discard the queued messages of every reader
+ *
+ * @chip: tof_sensor_chip pointer, chip->lock must be held, the reader FIFO
+ *        locks are taken here
+ */
+static void tof_fifo_flush(struct tof_sensor_chip *chip)
+{
+    struct tof_reader *reader;
+    list_for_each_entry(reader, &chip->readers, node) {
+        spin_lock(&reader->fifo_lock);
+        tof_reader_fifo_reset(reader);
+        spin_unlock(&reader->fifo_lock);
+    }
+}
+
 static void tof_publish_input_events(struct tof_sensor_chip *chip,
                                      struct tmf882x_msg *msg)
 {
@@ -211,22 +428,39 @@ static void tof_publish_input_events(struct tof_sensor_chip *chip,
     input_sync(chip->tof_idev);
 }
 
-static int tof_firmware_download(struct tof_sensor_chip *chip)
+/**
+ * tof_fw_cache_drop - Release the resident firmware image
+ *
+ * @chip: tof_sensor_chip pointer
+ */
+static void tof_fw_cache_drop(struct tof_sensor_chip *chip)
+{
+    kvfree(chip->fw_cache);
+    chip->fw_cache = NULL;
+    chip->fw_cache_size = 0;
+}
+
+/**
+ * tof_fw_cache_load - Load the firmware image and keep it resident
+ *
+ * The first image that converts into complete bootloader segments replaces
+ *  the cached image, later downloads need no filesystem access or parsing.
+ *
+ * @chip: tof_sensor_chip pointer
+ */
+static int tof_fw_cache_load(struct tof_sensor_chip *chip)
 {
     /*** ASSUME MUTEX IS ALREADY HELD ***/
-    int error;
+    int error = -ENOENT;
     int file_idx = 0;
+    int32_t size;
     const struct firmware *fw = NULL;
+    u8 *cache;
 
-    /* Iterate through all Firmware(s) to find one that works
-     */
     for (file_idx=0;
          chip->pdata->ram_patch_fname[file_idx] != NULL;
          file_idx++) {
 
-        /*** reset completion event that FWDL is starting ***/
-        reinit_completion(&chip->ram_patch_in_progress);
-
         dev_info(&chip->client->dev, "Trying firmware: \'%s\'...\n",
                 chip->pdata->ram_patch_fname[file_idx]);
 
@@ -239,25 +473,88 @@ static int tof_firmware_download(struct tof_sensor_chip *chip)
                      "Firmware not available \'%s\': %d\n",
                      chip->pdata->ram_patch_fname[file_idx], error);
             continue;
-        } else {
-            tof_ram_patch_callback(fw, chip);
         }
 
-        if (!wait_for_completion_interruptible_timeout(&chip->ram_patch_in_progress,
-                                                       msecs_to_jiffies(TOF_FWDL_TIMEOUT_MSEC))) {
+        // first pass sizes the segments, second pass fills them in
+        cache = NULL;
+        size = tmf882x_mode_bl_hex_to_seg(fw->data, fw->size, NULL, 0);
+        if (size > 0)
+            cache = kvmalloc(size, GFP_KERNEL);
+        if (cache &&
+            tmf882x_mode_bl_hex_to_seg(fw->data, fw->size, cache, size) != size) {
+            kvfree(cache);
+            cache = NULL;
+        }
+        release_firmware(fw);
+
+        if (!cache) {
             dev_err(&chip->client->dev,
-                    "Timeout waiting for Ram Patch \'%s\' Complete",
-                    chip->pdata->ram_patch_fname[file_idx]);
-            error = -EIO;
+                    "Firmware \'%s\' can not be converted: %d\n",
+                    chip->pdata->ram_patch_fname[file_idx], size);
+            error = size > 0 ? -ENOMEM : -EINVAL;
             continue;
         }
 
-        // assume everything was successful
-        error = 0;
+        tof_fw_cache_drop(chip);
+        chip->fw_cache = cache;
+        chip->fw_cache_size = size;
+        chip->fw_cache_crc = tmf882x_mode_bl_crc32(cache, size);
+        dev_info(&chip->client->dev,
+                 "Firmware \'%s\' cached: %d B, crc: %#010x\n",
+                 chip->pdata->ram_patch_fname[file_idx], size,
+                 chip->fw_cache_crc);
+        return 0;
     }
     return error;
 }
 
+/**
+ * tof_fw_running - Check whether the device still runs the cached image
+ *
+ * Must be called before the device is power-cycled, and right after the
+ *  firmware file was reloaded into the cache. The running app must report the
+ *  version read back after the last download, and that download must have
+ *  used an image with the fingerprint of the reloaded file.
+ *
+ * @chip: tof_sensor_chip pointer
+ */
+static bool tof_fw_running(struct tof_sensor_chip *chip)
+{
+    /*** ASSUME MUTEX IS ALREADY HELD ***/
+    u8 ver[TOF_FW_VER_LEN];
+
+    if (!chip->fw_app_valid)
+        return false;
+    // the patched app does not survive a power-off
+    if (chip->pdata->gpiod_enable &&
+        !gpiod_get_value_cansleep(chip->pdata->gpiod_enable))
+        return false;
+    if (!chip->fw_cache || (chip->fw_cache_crc != chip->fw_app_crc))
+        return false;
+    // re-open the core to read the info record of the running app
+    tmf882x_close(&chip->tof);
+    if (tmf882x_open(&chip->tof) ||
+        tmf882x_get_mode(&chip->tof) != TMF882X_MODE_APP)
+        return false;
+    if (tmf882x_get_firmware_ver(&chip->tof, ver, sizeof(ver)) != sizeof(ver))
+        return false;
+    return !memcmp(ver, chip->fw_app_ver, sizeof(ver));
+}
+
+static int tof_firmware_download(struct tof_sensor_chip *chip)
+{
+    /*** ASSUME MUTEX IS ALREADY HELD ***/
+    int error;
+
+    // the image is only read and parsed once, then kept resident
+    if (!chip->fw_cache) {
+        error = tof_fw_cache_load(chip);
+        if (error)
+            return error;
+    }
+    return tof_ram_patch(chip);
+}
+
 static int tof_poweron_device(struct tof_sensor_chip *chip)
 {
     int error = 0;
@@ -274,9 +571,10 @@ static int tof_poweron_device(struct tof_sensor_chip *chip)
     return 0;
 }
 
-static int tof_open_mode(struct tof_sensor_chip *chip, uint32_t mode)
+static int tof_enter_mode(struct tof_sensor_chip *chip, uint32_t mode)
 {
     tmf882x_mode_t req_mode = (tmf882x_mode_t) mode;
+    bool patched = false;
 
     if (tof_poweron_device(chip))
         return -1;
@@ -305,9 +603,11 @@ static int tof_open_mode(struct tof_sensor_chip *chip, uint32_t mode)
         // Try FWDL - this will perform no action if poweroff has not occurred
         //  result state is that of the FW if successful, or the bootloader if not
         if (chip->fwdl_needed) {
-            if (0 == tof_firmware_download(chip))
+            if (0 == tof_firmware_download(chip)) {
                 // FWDL is no longer necessary unless device loses power
                 chip->fwdl_needed = false;
+                patched = true;
+            }
         }
 
         // NO-OP If already in APP, else mode switch to the APP by loading from
@@ -317,12 +617,92 @@ static int tof_open_mode(struct tof_sensor_chip *chip, uint32_t mode)
             return -1;
         }
 
+        // remember what the patched app reports to recognize it later
+        if (patched) {
+            chip->fw_app_crc = chip->fw_cache_crc;
+            chip->fw_app_valid =
+                tmf882x_get_firmware_ver(&chip->tof, chip->fw_app_ver,
+                                         sizeof(chip->fw_app_ver)) ==
+                sizeof(chip->fw_app_ver);
+        }
+
     }
 
     // if we have gotten here then one of FWDL/ROM/FLASH load was successful
     return !(tmf882x_get_mode(&chip->tof) == req_mode);
 }
 
+/**
+ * tof_set_fw_result - Update the state reported by 'fw_ready'
+ *
+ * @chip: tof_sensor_chip pointer, chip->lock must be held
+ * @result: 0 if the app is running, negative error code otherwise
+ */
+static void tof_set_fw_result(struct tof_sensor_chip *chip, int result)
+{
+    if (chip->fwdl_result == result)
+        return;
+    chip->fwdl_result = result;
+    sysfs_notify(&chip->client->dev.kobj, NULL, "fw_ready");
+}
+
+static int tof_open_mode(struct tof_sensor_chip *chip, uint32_t mode)
+{
+    int error = tof_enter_mode(chip, mode);
+    // a later open retries a failed probe time bring-up, report the outcome
+    if ((mode == TMF882X_MODE_APP) && !chip->fwdl_busy)
+        tof_set_fw_result(chip, error ? -EIO : 0);
+    return error;
+}
+
+/**
+ * tof_fwdl_work - Bring up the device with FWDL in the background of probe
+ *
+ * @work: fwdl_work of the tof_sensor_chip
+ */
+static void tof_fwdl_work(struct work_struct *work)
+{
+    struct tof_sensor_chip *chip =
+        container_of(work, struct tof_sensor_chip, fwdl_work);
+    int error = -ENODEV;
+
+    AMS_MUTEX_LOCK(&chip->lock);
+    if (!chip->driver_remove) {
+        error = tof_hard_reset(chip);
+        if (error)
+            dev_err(&chip->client->dev, "Chip init failed: %d\n", error);
+        else if (tmf882x_stop(&chip->tof))
+            dev_info(&chip->client->dev, "Error stopping measurements\n");
+        // stopping measurements, lets flush the ring buffer
+        tof_fifo_flush(chip);
+    }
+    chip->fwdl_result = error;
+    chip->fwdl_busy = false;
+    AMS_MUTEX_UNLOCK(&chip->lock);
+    complete_all(&chip->fwdl_done);
+    sysfs_notify(&chip->client->dev.kobj, NULL, "fw_ready");
+    dev_info(&chip->client->dev, "%s: device %s\n", __func__,
+             error ? "init failed" : "ready");
+}
+
+/**
+ * tof_wait_fw_ready - Wait for the probe time FWDL to finish
+ *
+ * @chip: tof_sensor_chip pointer, chip->lock must not be held
+ * @nonblock: return -EAGAIN instead of waiting
+ *
+ * Users that arrive during the download wait for it instead of starting
+ * another one. A failed download is retried by the next tof_open_mode().
+ */
+static int tof_wait_fw_ready(struct tof_sensor_chip *chip, bool nonblock)
+{
+    if (completion_done(&chip->fwdl_done))
+        return 0;
+    if (nonblock)
+        return -EAGAIN;
+    return wait_for_completion_interruptible(&chip->fwdl_done);
+}
+
 static int tof_set_default_config(struct tof_sensor_chip *chip)
 {
     int error;
@@ -376,6 +756,9 @@ static ssize_t mode_store(struct device * dev,
     int error;
     dev_info(dev, "%s\n", __func__);
     sscanf(buf, "%i", &req_mode);
+    error = tof_wait_fw_ready(chip, false);
+    if (error)
+        return error;
     AMS_MUTEX_LOCK(&chip->lock);
     error = tof_open_mode(chip, req_mode);
     if (error) {
@@ -426,6 +809,9 @@ static ssize_t chip_enable_store(struct device * dev,
     error = sscanf(buf, "%i", &req_state);
     if (error != 1)
         return -1;
+    error = tof_wait_fw_ready(chip, false);
+    if (error)
+        return error;
     AMS_MUTEX_LOCK(&chip->lock);
     if (!chip->pdata->gpiod_enable) {
         AMS_MUTEX_UNLOCK(&chip->lock);
@@ -472,134 +858,332 @@ static ssize_t driver_debug_store(struct device * dev,
     return count;
 }
 
-static ssize_t firmware_version_show(struct device * dev,
-                                     struct device_attribute * attr,
-                                     char * buf)
+static unsigned int tof_fifo_size_clamp(unsigned int size)
 {
-    struct tof_sensor_chip *chip = dev_get_drvdata(dev);
-    int len = 0;
-    char str[17] = {0};
-    dev_info(dev, "%s\n", __func__);
+    size = clamp_t(unsigned int, size, TOF_FIFO_MIN_SIZE, TOF_FIFO_MAX_SIZE);
+    return roundup_pow_of_two(size);
+}
+
+static ssize_t tof_fifo_size_store(struct tof_sensor_chip *chip,
+                                   enum tof_fifo_lane_id lane,
+                                   const char *buf, size_t count)
+{
+    unsigned int size;
+    if (sscanf(buf, "%u", &size) != 1)
+        return -EINVAL;
     AMS_MUTEX_LOCK(&chip->lock);
-    len = tmf882x_get_firmware_ver(&chip->tof, str, sizeof(str));
-    if (len < 0) {
+    // FIFOs are sized at open(), only resize while no reader is open
+    if (!list_empty(&chip->readers)) {
         AMS_MUTEX_UNLOCK(&chip->lock);
-        return -EIO;
+        return -EBUSY;
     }
-    len = scnprintf(buf, PAGE_SIZE, "%u.%u.%u.%u\n", str[0], str[1], str[2], str[3]);
+    chip->fifo_size[lane] = tof_fifo_size_clamp(size);
     AMS_MUTEX_UNLOCK(&chip->lock);
-    return len;
+    return count;
 }
 
-static ssize_t device_uid_show(struct device * dev,
+static ssize_t fifo_size_show(struct device * dev,
+                              struct device_attribute * attr,
+                              char * buf)
+{
+    struct tof_sensor_chip *chip = dev_get_drvdata(dev);
+    dev_info(dev, "%s\n", __func__);
+    return scnprintf(buf, PAGE_SIZE, "%u\n", chip->fifo_size[TOF_LANE_BULK]);
+}
+
+static ssize_t fifo_size_store(struct device * dev,
                                struct device_attribute * attr,
-                               char * buf)
+                               const char * buf,
+                               size_t count)
 {
     struct tof_sensor_chip *chip = dev_get_drvdata(dev);
-    int len = 0;
-    struct tmf882x_mode_app_dev_UID uid;
-    int error;
     dev_info(dev, "%s\n", __func__);
-    AMS_MUTEX_LOCK(&chip->lock);
+    return tof_fifo_size_store(chip, TOF_LANE_BULK, buf, count);
+}
 
-    //UID is only available through the application so we must open it
-    error = tof_open_mode(chip, TMF882X_MODE_APP);
-    if (error) {
-        dev_err(&chip->client->dev, "Error powering-on device");
-        AMS_MUTEX_UNLOCK(&chip->lock);
-        return -EIO;
-    }
-    memset(&uid, 0, sizeof(uid));
-    error = tmf882x_ioctl(&chip->tof, IOCAPP_DEV_UID, NULL, &uid);
-    if (error || (uid.len == 0)) {
-        AMS_MUTEX_UNLOCK(&chip->lock);
-        return -EIO;
-    }
-    if (!chip->open_refcnt) {
-        tmf882x_close(&chip->tof);
-    }
-    len = scnprintf(buf, PAGE_SIZE, "%u.%u.%u.%u\n",
-                    uid.uid[0], uid.uid[1], uid.uid[2], uid.uid[3]);
-    AMS_MUTEX_UNLOCK(&chip->lock);
-    return len;
+static ssize_t result_fifo_size_show(struct device * dev,
+                                     struct device_attribute * attr,
+                                     char * buf)
+{
+    struct tof_sensor_chip *chip = dev_get_drvdata(dev);
+    dev_info(dev, "%s\n", __func__);
+    return scnprintf(buf, PAGE_SIZE, "%u\n", chip->fifo_size[TOF_LANE_RESULT]);
 }
 
-static ssize_t device_revision_show(struct device * dev,
+static ssize_t result_fifo_size_store(struct device * dev,
+                                      struct device_attribute * attr,
+                                      const char * buf,
+                                      size_t count)
+{
+    struct tof_sensor_chip *chip = dev_get_drvdata(dev);
+    dev_info(dev, "%s\n", __func__);
+    return tof_fifo_size_store(chip, TOF_LANE_RESULT, buf, count);
+}
+
+static ssize_t overflow_policy_show(struct device * dev,
                                     struct device_attribute * attr,
                                     char * buf)
 {
     struct tof_sensor_chip *chip = dev_get_drvdata(dev);
-    int len = 0;
-    char revision[17] = {0};
     dev_info(dev, "%s\n", __func__);
-    AMS_MUTEX_LOCK(&chip->lock);
-    if (tof_poweron_device(chip)) {
-        AMS_MUTEX_UNLOCK(&chip->lock);
-        return -EIO;
-    }
-    len = tmf882x_get_device_revision(&chip->tof, revision, sizeof(revision));
-    if (len < 0) {
-        AMS_MUTEX_UNLOCK(&chip->lock);
-        return -EIO;
-    }
-    len = scnprintf(buf, PAGE_SIZE, "%u.%u\n", revision[0], revision[1]);
-    AMS_MUTEX_UNLOCK(&chip->lock);
-    return len;
+    return scnprintf(buf, PAGE_SIZE, "%d\n", chip->overflow_policy);
 }
 
-static ssize_t registers_show(struct device * dev,
-                              struct device_attribute * attr,
-                              char * buf)
+static ssize_t overflow_policy_store(struct device * dev,
+                                     struct device_attribute * attr,
+                                     const char * buf,
+                                     size_t count)
 {
-    int per_line = 4;
-    int len = 0;
-    int idx, per_line_idx;
-    int bufsize = PAGE_SIZE;
-    int error;
-    char regs[MAX_REGS] = {0};
     struct tof_sensor_chip *chip = dev_get_drvdata(dev);
-
+    int policy;
     dev_info(dev, "%s\n", __func__);
+    if (sscanf(buf, "%i", &policy) != 1)
+        return -EINVAL;
+    if ((policy < 0) || (policy >= TOF_NUM_OVERFLOW_POLICIES))
+        return -EINVAL;
     AMS_MUTEX_LOCK(&chip->lock);
-    error = tof_frwk_i2c_read(chip, 0x00, regs, MAX_REGS);
-    if (error < 0) {
-        dev_err(&chip->client->dev, "Read all registers failed: %d\n", error);
-        return error;
-    }
-    if (error) {
-        AMS_MUTEX_UNLOCK(&chip->lock);
-        return error;
-    }
-
-    for (idx = 0; idx < MAX_REGS; idx += per_line) {
-        len += scnprintf(buf + len, bufsize - len, "0x%02x:", idx);
-        for (per_line_idx = 0; per_line_idx < per_line; per_line_idx++) {
-            len += scnprintf(buf + len, bufsize - len, " ");
-            len += scnprintf(buf + len, bufsize - len, "%02x", regs[idx+per_line_idx]);
-        }
-        len += scnprintf(buf + len, bufsize - len, "\n");
-    }
+    chip->overflow_policy = policy;
     AMS_MUTEX_UNLOCK(&chip->lock);
-    return len;
+    return count;
 }
 
-static ssize_t register_write_store(struct device * dev,
-                                    struct device_attribute * attr,
-                                    const char * buf,
-                                    size_t count)
+static ssize_t hist_backpressure_show(struct device * dev,
+                                      struct device_attribute * attr,
+                                      char * buf)
 {
-    char preg;
-    char pval;
-    char pmask = -1;
-    int numparams;
-    int rc;
     struct tof_sensor_chip *chip = dev_get_drvdata(dev);
     dev_info(dev, "%s\n", __func__);
+    return scnprintf(buf, PAGE_SIZE, "%u:%u:%u\n", chip->hist_decimation,
+                     chip->hist_high_water, chip->hist_low_water);
+}
 
-    numparams = sscanf(buf, "%hhi:%hhi:%hhi", &preg, &pval, &pmask);
-    if ((numparams < 2) || (numparams > 3))
-        return -EINVAL;
-    if ((numparams >= 1) && (preg < 0))
+static ssize_t hist_backpressure_store(struct device * dev,
+                                       struct device_attribute * attr,
+                                       const char * buf,
+                                       size_t count)
+{
+    struct tof_sensor_chip *chip = dev_get_drvdata(dev);
+    u32 decimation;
+    u32 high = 0;
+    u32 low = 0;
+    int numparams;
+    dev_info(dev, "%s\n", __func__);
+    numparams = sscanf(buf, "%u:%u:%u", &decimation, &high, &low);
+    if ((numparams != 1) && (numparams != 3))
+        return -EINVAL;
+    if ((numparams == 3) && ((high > 100) || (low >= high)))
+        return -EINVAL;
+    AMS_MUTEX_LOCK(&chip->lock);
+    chip->hist_decimation = decimation;
+    if (numparams == 3) {
+        chip->hist_high_water = high;
+        chip->hist_low_water = low;
+    }
+    AMS_MUTEX_UNLOCK(&chip->lock);
+    return count;
+}
+
+static ssize_t fw_ready_show(struct device * dev,
+                             struct device_attribute * attr,
+                             char * buf)
+{
+    struct tof_sensor_chip *chip = dev_get_drvdata(dev);
+    int state;
+    dev_info(dev, "%s\n", __func__);
+    AMS_MUTEX_LOCK(&chip->lock);
+    state = chip->fwdl_busy ? 0 : (chip->fwdl_result ? chip->fwdl_result : 1);
+    AMS_MUTEX_UNLOCK(&chip->lock);
+    return scnprintf(buf, PAGE_SIZE, "%d\n", state);
+}
+
+static ssize_t fwdl_time_us_show(struct device * dev,
+                                 struct device_attribute * attr,
+                                 char * buf)
+{
+    struct tof_sensor_chip *chip = dev_get_drvdata(dev);
+    ssize_t len;
+    dev_info(dev, "%s\n", __func__);
+    AMS_MUTEX_LOCK(&chip->lock);
+    len = scnprintf(buf, PAGE_SIZE, "%llu\n", chip->fwdl_time_us);
+    AMS_MUTEX_UNLOCK(&chip->lock);
+    return len;
+}
+
+static ssize_t fw_cache_show(struct device * dev,
+                             struct device_attribute * attr,
+                             char * buf)
+{
+    struct tof_sensor_chip *chip = dev_get_drvdata(dev);
+    ssize_t len;
+    dev_info(dev, "%s\n", __func__);
+    AMS_MUTEX_LOCK(&chip->lock);
+    len = scnprintf(buf, PAGE_SIZE, "%zu\n", chip->fw_cache_size);
+    AMS_MUTEX_UNLOCK(&chip->lock);
+    return len;
+}
+
+static ssize_t fw_cache_store(struct device * dev,
+                              struct device_attribute * attr,
+                              const char * buf, size_t count)
+{
+    struct tof_sensor_chip *chip = dev_get_drvdata(dev);
+    unsigned int refresh;
+    int error = 0;
+    dev_info(dev, "%s: %s", __func__, buf);
+    if (sscanf(buf, "%u", &refresh) != 1 || refresh > 1)
+        return -EINVAL;
+    AMS_MUTEX_LOCK(&chip->lock);
+    if (refresh)
+        error = tof_fw_cache_load(chip);
+    else
+        tof_fw_cache_drop(chip);
+    AMS_MUTEX_UNLOCK(&chip->lock);
+    return error ? error : count;
+}
+
+static ssize_t poll_stats_show(struct device * dev,
+                               struct device_attribute * attr,
+                               char * buf)
+{
+    struct tof_sensor_chip *chip = dev_get_drvdata(dev);
+    ssize_t len;
+    dev_info(dev, "%s\n", __func__);
+    AMS_MUTEX_LOCK(&chip->lock);
+    len = scnprintf(buf, PAGE_SIZE, "%u:%u:%u:%llu\n", chip->poll.polls,
+                    chip->poll.hits, chip->poll.early,
+                    div_u64(chip->poll.frame_ns, NSEC_PER_USEC));
+    AMS_MUTEX_UNLOCK(&chip->lock);
+    return len;
+}
+
+static ssize_t firmware_version_show(struct device * dev,
+                                     struct device_attribute * attr,
+                                     char * buf)
+{
+    struct tof_sensor_chip *chip = dev_get_drvdata(dev);
+    int len = 0;
+    char str[17] = {0};
+    dev_info(dev, "%s\n", __func__);
+    AMS_MUTEX_LOCK(&chip->lock);
+    len = tmf882x_get_firmware_ver(&chip->tof, str, sizeof(str));
+    if (len < 0) {
+        AMS_MUTEX_UNLOCK(&chip->lock);
+        return -EIO;
+    }
+    len = scnprintf(buf, PAGE_SIZE, "%u.%u.%u.%u\n", str[0], str[1], str[2], str[3]);
+    AMS_MUTEX_UNLOCK(&chip->lock);
+    return len;
+}
+
+static ssize_t device_uid_show(struct device * dev,
+                               struct device_attribute * attr,
+                               char * buf)
+{
+    struct tof_sensor_chip *chip = dev_get_drvdata(dev);
+    int len = 0;
+    struct tmf882x_mode_app_dev_UID uid;
+    int error;
+    dev_info(dev, "%s\n", __func__);
+    AMS_MUTEX_LOCK(&chip->lock);
+
+    //UID is only available through the application so we must open it
+    error = tof_open_mode(chip, TMF882X_MODE_APP);
+    if (error) {
+        dev_err(&chip->client->dev, "Error powering-on device");
+        AMS_MUTEX_UNLOCK(&chip->lock);
+        return -EIO;
+    }
+    memset(&uid, 0, sizeof(uid));
+    error = tmf882x_ioctl(&chip->tof, IOCAPP_DEV_UID, NULL, &uid);
+    if (error || (uid.len == 0)) {
+        AMS_MUTEX_UNLOCK(&chip->lock);
+        return -EIO;
+    }
+    if (!chip->open_refcnt) {
+        tmf882x_close(&chip->tof);
+    }
+    len = scnprintf(buf, PAGE_SIZE, "%u.%u.%u.%u\n",
+                    uid.uid[0], uid.uid[1], uid.uid[2], uid.uid[3]);
+    AMS_MUTEX_UNLOCK(&chip->lock);
+    return len;
+}
+
+static ssize_t device_revision_show(struct device * dev,
+                                    struct device_attribute * attr,
+                                    char * buf)
+{
+    struct tof_sensor_chip *chip = dev_get_drvdata(dev);
+    int len = 0;
+    char revision[17] = {0};
+    dev_info(dev, "%s\n", __func__);
+    AMS_MUTEX_LOCK(&chip->lock);
+    if (tof_poweron_device(chip)) {
+        AMS_MUTEX_UNLOCK(&chip->lock);
+        return -EIO;
+    }
+    len = tmf882x_get_device_revision(&chip->tof, revision, sizeof(revision));
+    if (len < 0) {
+        AMS_MUTEX_UNLOCK(&chip->lock);
+        return -EIO;
+    }
+    len = scnprintf(buf, PAGE_SIZE, "%u.%u\n", revision[0], revision[1]);
+    AMS_MUTEX_UNLOCK(&chip->lock);
+    return len;
+}
+
+static ssize_t registers_show(struct device * dev,
+                              struct device_attribute * attr,
+                              char * buf)
+{
+    int per_line = 4;
+    int len = 0;
+    int idx, per_line_idx;
+    int bufsize = PAGE_SIZE;
+    int error;
+    char regs[MAX_REGS] = {0};
+    struct tof_sensor_chip *chip = dev_get_drvdata(dev);
+
+    dev_info(dev, "%s\n", __func__);
+    AMS_MUTEX_LOCK(&chip->lock);
+    error = tof_frwk_i2c_read(chip, 0x00, regs, MAX_REGS);
+    if (error < 0) {
+        dev_err(&chip->client->dev, "Read all registers failed: %d\n", error);
+        return error;
+    }
+    if (error) {
+        AMS_MUTEX_UNLOCK(&chip->lock);
+        return error;
+    }
+
+    for (idx = 0; idx < MAX_REGS; idx += per_line) {
+        len += scnprintf(buf + len, bufsize - len, "0x%02x:", idx);
+        for (per_line_idx = 0; per_line_idx < per_line; per_line_idx++) {
+            len += scnprintf(buf + len, bufsize - len, " ");
+            len += scnprintf(buf + len, bufsize - len, "%02x", regs[idx+per_line_idx]);
+        }
+        len += scnprintf(buf + len, bufsize - len, "\n");
+    }
+    AMS_MUTEX_UNLOCK(&chip->lock);
+    return len;
+}
+
+static ssize_t register_write_store(struct device * dev,
+                                    struct device_attribute * attr,
+                                    const char * buf,
+                                    size_t count)
+{
+    char preg;
+    char pval;
+    char pmask = -1;
+    int numparams;
+    int rc;
+    struct tof_sensor_chip *chip = dev_get_drvdata(dev);
+    dev_info(dev, "%s\n", __func__);
+
+    numparams = sscanf(buf, "%hhi:%hhi:%hhi", &preg, &pval, &pmask);
+    if ((numparams < 2) || (numparams > 3))
+        return -EINVAL;
+    if ((numparams >= 1) && (preg < 0))
         return -EINVAL;
     if ((numparams >= 2) && (preg < 0 || preg > 0xff))
         return -EINVAL;
@@ -621,11 +1205,28 @@ static ssize_t request_ram_patch_store(struct device * dev,
                                        size_t count)
 {
     struct tof_sensor_chip *chip = dev_get_drvdata(dev);
+    bool reloaded;
     int error = 0;
     dev_info(dev, "%s\n", __func__);
+    error = tof_wait_fw_ready(chip, false);
+    if (error)
+        return error;
     AMS_MUTEX_LOCK(&chip->lock);
+    // pick up the firmware file as it is now, the resident image is only
+    //  meant for re-downloads after a power cycle or resume
+    reloaded = !tof_fw_cache_load(chip);
+    if (!reloaded)
+        dev_warn(dev, "Firmware file not reloaded, using the cached image\n");
     /***** Try to re-open the app (perform fwdl if available) *****/
-    error = tof_hard_reset(chip);
+    // only skip if the file on disk matches the image that is running
+    if (reloaded && tof_fw_running(chip)) {
+        // a power cycle would only download the same image again
+        dev_info(dev, "Firmware %#010x already running, skip FWDL\n",
+                 chip->fw_app_crc);
+        error = tof_open_mode(chip, TMF882X_MODE_APP);
+    } else {
+        error = tof_hard_reset(chip);
+    }
     if (error) {
         dev_err(dev, "Error re-patching device\n");
         AMS_MUTEX_UNLOCK(&chip->lock);
@@ -662,8 +1263,12 @@ static ssize_t capture_store(struct device * dev,
 {
     struct tof_sensor_chip *chip = dev_get_drvdata(dev);
     int capture;
+    int error;
 
     sscanf(buf, "%i", &capture);
+    error = tof_wait_fw_ready(chip, false);
+    if (error)
+        return error;
     AMS_MUTEX_LOCK(&chip->lock);
     if (capture) {
         dev_info(dev, "%s: start capture\n", __func__);
@@ -687,7 +1292,7 @@ static ssize_t capture_store(struct device * dev,
             return -EIO;
         }
         // stopping measurements, lets flush the ring buffer
-        kfifo_reset(&chip->fifo_out);
+        tof_fifo_flush(chip);
     }
     AMS_MUTEX_UNLOCK(&chip->lock);
     return count;
@@ -736,7 +1341,7 @@ static ssize_t short_range_mode_store(struct device * dev,
         return -EIO;
     }
 
-    kfifo_reset(&chip->fifo_out);
+    tof_fifo_flush(chip);
     AMS_MUTEX_UNLOCK(&chip->lock);
     return count;
 }
@@ -802,7 +1407,7 @@ static ssize_t iterations_store(struct device * dev,
         AMS_MUTEX_UNLOCK(&chip->lock);
         return -EIO;
     }
-    kfifo_reset(&chip->fifo_out);
+    tof_fifo_flush(chip);
     AMS_MUTEX_UNLOCK(&chip->lock);
     return count;
 }
@@ -836,7 +1441,7 @@ static ssize_t alg_setting_store(struct device * dev,
         AMS_MUTEX_UNLOCK(&chip->lock);
         return -EIO;
     }
-    kfifo_reset(&chip->fifo_out);
+    tof_fifo_flush(chip);
     AMS_MUTEX_UNLOCK(&chip->lock);
     return count;
 }
@@ -870,7 +1475,7 @@ static ssize_t power_cfg_store(struct device * dev,
         AMS_MUTEX_UNLOCK(&chip->lock);
         return -EIO;
     }
-    kfifo_reset(&chip->fifo_out);
+    tof_fifo_flush(chip);
     AMS_MUTEX_UNLOCK(&chip->lock);
     return count;
 }
@@ -904,7 +1509,7 @@ static ssize_t gpio_0_store(struct device * dev,
         AMS_MUTEX_UNLOCK(&chip->lock);
         return -EIO;
     }
-    kfifo_reset(&chip->fifo_out);
+    tof_fifo_flush(chip);
     AMS_MUTEX_UNLOCK(&chip->lock);
     return count;
 }
@@ -938,7 +1543,7 @@ static ssize_t gpio_1_store(struct device * dev,
         AMS_MUTEX_UNLOCK(&chip->lock);
         return -EIO;
     }
-    kfifo_reset(&chip->fifo_out);
+    tof_fifo_flush(chip);
     AMS_MUTEX_UNLOCK(&chip->lock);
     return count;
 }
@@ -972,7 +1577,7 @@ static ssize_t histogram_dump_store(struct device * dev,
         AMS_MUTEX_UNLOCK(&chip->lock);
         return -EIO;
     }
-    kfifo_reset(&chip->fifo_out);
+    tof_fifo_flush(chip);
     AMS_MUTEX_UNLOCK(&chip->lock);
     return count;
 }
@@ -1008,7 +1613,7 @@ static ssize_t spad_map_id_store(struct device * dev,
     }
     // read out fresh spad configuration from device, overwrite local copy
     chip->tof_spad_uncommitted = false;
-    kfifo_reset(&chip->fifo_out);
+    tof_fifo_flush(chip);
     AMS_MUTEX_UNLOCK(&chip->lock);
     return count;
 }
@@ -1042,7 +1647,7 @@ static ssize_t zone_mask_store(struct device * dev,
         AMS_MUTEX_UNLOCK(&chip->lock);
         return -EIO;
     }
-    kfifo_reset(&chip->fifo_out);
+    tof_fifo_flush(chip);
     AMS_MUTEX_UNLOCK(&chip->lock);
     return count;
 }
@@ -1076,7 +1681,7 @@ static ssize_t conf_threshold_store(struct device * dev,
         AMS_MUTEX_UNLOCK(&chip->lock);
         return -EIO;
     }
-    kfifo_reset(&chip->fifo_out);
+    tof_fifo_flush(chip);
     AMS_MUTEX_UNLOCK(&chip->lock);
     return count;
 }
@@ -1110,7 +1715,7 @@ static ssize_t low_threshold_store(struct device * dev,
         AMS_MUTEX_UNLOCK(&chip->lock);
         return -EIO;
     }
-    kfifo_reset(&chip->fifo_out);
+    tof_fifo_flush(chip);
     AMS_MUTEX_UNLOCK(&chip->lock);
     return count;
 }
@@ -1144,7 +1749,7 @@ static ssize_t high_threshold_store(struct device * dev,
         AMS_MUTEX_UNLOCK(&chip->lock);
         return -EIO;
     }
-    kfifo_reset(&chip->fifo_out);
+    tof_fifo_flush(chip);
     AMS_MUTEX_UNLOCK(&chip->lock);
     return count;
 }
@@ -1178,7 +1783,7 @@ static ssize_t persistence_store(struct device * dev,
         AMS_MUTEX_UNLOCK(&chip->lock);
         return -EIO;
     }
-    kfifo_reset(&chip->fifo_out);
+    tof_fifo_flush(chip);
     AMS_MUTEX_UNLOCK(&chip->lock);
     return count;
 }
@@ -1227,7 +1832,7 @@ static ssize_t mode_8x8_store(struct device * dev,
         // SPAD Map ID is set to custom time-multiplexed mode for 8x8 mode
         chip->tof_cfg.spad_map_id = TMF8X2X_COM_SPAD_MAP_ID__spad_map_id__user_defined_2;
     }
-    kfifo_reset(&chip->fifo_out);
+    tof_fifo_flush(chip);
     AMS_MUTEX_UNLOCK(&chip->lock);
     return count;
 }
@@ -1683,7 +2288,7 @@ static ssize_t commit_spad_cfg_store(struct device * dev,
             return -EIO;
         }
         chip->tof_spad_uncommitted = false;
-        kfifo_reset(&chip->fifo_out);
+        tof_fifo_flush(chip);
         AMS_MUTEX_UNLOCK(&chip->lock);
     }
     return count;
@@ -1949,6 +2554,14 @@ static ssize_t factory_calibration_read(struct file * f, struct kobject * kobj,
 static DEVICE_ATTR_RW(mode);
 static DEVICE_ATTR_RW(chip_enable);
 static DEVICE_ATTR_RW(driver_debug);
+static DEVICE_ATTR_RW(fifo_size);
+static DEVICE_ATTR_RW(result_fifo_size);
+static DEVICE_ATTR_RW(overflow_policy);
+static DEVICE_ATTR_RW(hist_backpressure);
+static DEVICE_ATTR_RW(fw_cache);
+static DEVICE_ATTR_RO(poll_stats);
+static DEVICE_ATTR_RO(fwdl_time_us);
+static DEVICE_ATTR_RO(fw_ready);
 /******* READ-ONLY attributes ******/
 static DEVICE_ATTR_RO(firmware_version);
 static DEVICE_ATTR_RO(registers);
@@ -2014,6 +2627,14 @@ static struct attribute *tof_common_attrs[] = {
     &dev_attr_mode.attr,
     &dev_attr_chip_enable.attr,
     &dev_attr_driver_debug.attr,
+    &dev_attr_fifo_size.attr,
+    &dev_attr_result_fifo_size.attr,
+    &dev_attr_overflow_policy.attr,
+    &dev_attr_hist_backpressure.attr,
+    &dev_attr_poll_stats.attr,
+    &dev_attr_fwdl_time_us.attr,
+    &dev_attr_fw_cache.attr,
+    &dev_attr_fw_ready.attr,
     &dev_attr_firmware_version.attr,
     &dev_attr_registers.attr,
     &dev_attr_register_write.attr,
@@ -2114,105 +2735,323 @@ int tof_frwk_i2c_read(struct tof_sensor_chip *chip, char reg, char *buf, int len
 }
 
 /**
- * tof_frwk_i2c_write - Write nuber of bytes starting at a specific address over I2C
+ * tof_i2c_raw_write - Write nuber of bytes starting at a specific address over I2C
  *
  * @client: the i2c client
  * @reg: the i2c register address
  * @buf: pointer to a buffer that will contain the data to write
  * @len: number of bytes to write
+ *
+ * The register byte and the data go out as two segments of one write when
+ * the adapter supports I2C_M_NOSTART. Otherwise they are joined in the
+ * preallocated per-chip bounce buffer, so no allocation happens here.
  */
-int tof_frwk_i2c_write(struct tof_sensor_chip *chip, char reg, const char *buf, int len)
+static int tof_i2c_raw_write(struct tof_sensor_chip *chip, char reg,
+                             const char *buf, int len)
 {
     struct i2c_client *client = chip->client;
-    u8 *addr_buf;
-    struct i2c_msg msg;
-    int idx = reg;
+    u8 addr = reg;
+    struct i2c_msg msgs[2];
+    int num_msgs;
+    int idx;
     int ret;
     char debug[120];
     u32 strsize = 0;
 
-    addr_buf = kmalloc(len + 1, GFP_KERNEL);
-    if (!addr_buf)
-        return -ENOMEM;
-
-    addr_buf[0] = reg;
-    memcpy(&addr_buf[1], buf, len);
-    msg.flags = 0;
-    msg.addr = client->addr;
-    msg.buf = addr_buf;
-    msg.len = len + 1;
+    if ((len < 0) || (len + 1 > TOF_I2C_WBUF_SIZE))
+        return -EINVAL;
 
-    ret = i2c_transfer(client->adapter, &msg, 1);
-    if (ret != 1) {
+    msgs[0].flags = 0;
+    msgs[0].addr = client->addr;
+    if (chip->i2c_nostart && len) {
+        msgs[0].buf = &addr;
+        msgs[0].len = 1;
+        msgs[1].flags = I2C_M_NOSTART;
+        msgs[1].addr = client->addr;
+        msgs[1].buf = (u8 *)buf;
+        msgs[1].len = len;
+        num_msgs = 2;
+        ret = i2c_transfer(client->adapter, msgs, num_msgs);
+    } else {
+        AMS_MUTEX_LOCK(&chip->i2c_wbuf_lock);
+        chip->i2c_wbuf[0] = reg;
+        memcpy(&chip->i2c_wbuf[1], buf, len);
+        msgs[0].buf = chip->i2c_wbuf;
+        msgs[0].len = len + 1;
+        num_msgs = 1;
+        ret = i2c_transfer(client->adapter, msgs, num_msgs);
+        AMS_MUTEX_UNLOCK(&chip->i2c_wbuf_lock);
+    }
+    if (ret != num_msgs) {
         dev_err(&client->dev, "i2c_transfer failed: %d msg_len: %u", ret, len);
     }
     if (chip->driver_debug > 2) {
-        strsize = scnprintf(debug, sizeof(debug), "i2c_write: ");
-        for(idx = 0; (ret == 1) && (idx < msg.len); idx++) {
-            strsize += scnprintf(debug + strsize, sizeof(debug) - strsize, "%02x ", addr_buf[idx]);
+        strsize = scnprintf(debug, sizeof(debug), "i2c_write: %02x ", addr);
+        for(idx = 0; (ret == num_msgs) && (idx < len); idx++) {
+            strsize += scnprintf(debug + strsize, sizeof(debug) - strsize, "%02x ", (u8)buf[idx]);
         }
         dev_info(&client->dev, "%s", debug);
     }
 
-    kfree(addr_buf);
-    return ret < 0 ? ret : (ret != 1 ? -EIO : 0);
+    return ret < 0 ? ret : (ret != num_msgs ? -EIO : 0);
 }
 
 /**
- * tof_frwk_i2c_write_mask - Write a byte to the specified address with a given bitmask
+ * tof_frwk_regcache_drop - Drop the whole register cache
  *
- * @client: the i2c client
- * @reg: the i2c register address
- * @val: byte to write
- * @mask: bitmask to apply to address before writing
+ * @chip: tof_sensor_chip pointer
+ *
+ * Called after any command that resets the device, so the next access of a
+ * cached register re-reads it.
  */
-static int tof_frwk_i2c_write_mask(struct tof_sensor_chip *chip, char reg,
-                                   const char *val, char mask)
+void tof_frwk_regcache_drop(struct tof_sensor_chip *chip)
 {
-    int ret;
-    u8 temp;
-
-    ret = tof_frwk_i2c_read(chip, reg, &temp, 1);
-    temp &= ~mask;
-    temp |= *val;
-    ret = tof_frwk_i2c_write(chip, reg, &temp, 1);
-
-    return ret;
+    if (chip->regmap)
+        regcache_drop_region(chip->regmap, 0, TOF_REGMAP_MAX_REG);
 }
 
 /**
- * tof_hard_reset - use GPIO Chip Enable to reset the device
+ * tof_regcache_invalidate - Drop cached registers a write may have changed
  *
- * @tof_chip: tof_sensor_chip pointer
+ * @chip: tof_sensor_chip pointer
+ * @reg: first register written
+ * @len: number of registers written
+ *
+ * Writing the CPU status (standby/wakeup/bootmatrix) or the reset reason
+ * register may reset the device, so the whole cache is dropped for those.
  */
-static int tof_hard_reset(struct tof_sensor_chip *chip)
+static void tof_regcache_invalidate(struct tof_sensor_chip *chip, u8 reg,
+                                    int len)
 {
-    int error = 0;
-
-    (void) tof_poweroff_device(chip);
-    error = tof_open_mode(chip, TMF882X_MODE_APP);
-    if (error) {
-        dev_err(&chip->client->dev, "Error powering up device: %d\n", error);
-        return error;
-    }
+    unsigned int last = reg + len - 1;
 
-    return error;
+    if (!chip->regmap || (len <= 0))
+        return;
+    if (((reg <= TMF882X_STAT) && (last >= TMF882X_STAT)) ||
+        ((reg <= TMF882X_RESETREASON) && (last >= TMF882X_RESETREASON)))
+        tof_frwk_regcache_drop(chip);
+    else
+        regcache_drop_region(chip->regmap, reg, last);
 }
 
 /**
- * tof_get_gpio_config - Get GPIO config from DT
+ * tof_frwk_i2c_write - Write nuber of bytes starting at a specific address over I2C
  *
- * @tof_chip: tof_sensor_chip pointer
+ * @client: the i2c client
+ * @reg: the i2c register address
+ * @buf: pointer to a buffer that will contain the data to write
+ * @len: number of bytes to write
+ *
+ * Block writes bypass the register cache, any cached register they cover is
+ * dropped and re-read on next access.
  */
-static int tof_get_gpio_config(struct tof_sensor_chip *tof_chip)
+int tof_frwk_i2c_write(struct tof_sensor_chip *chip, char reg, const char *buf, int len)
 {
-    int error;
-    struct device *dev;
-    struct gpio_desc *gpiod;
+    int ret = tof_i2c_raw_write(chip, reg, buf, len);
+    tof_regcache_invalidate(chip, reg, len);
+    return ret;
+}
 
-    if (!tof_chip->client)
-        return -EINVAL;
-    dev = &tof_chip->client->dev;
+/**
+ * tof_frwk_reg_read - Read a single register through the register cache
+ *
+ * @chip: tof_sensor_chip pointer
+ * @reg: the i2c register address
+ * @val: register value
+ */
+int tof_frwk_reg_read(struct tof_sensor_chip *chip, u8 reg, u8 *val)
+{
+    unsigned int data;
+    int ret;
+
+    ret = regmap_read(chip->regmap, reg, &data);
+    if (!ret)
+        *val = data;
+    return ret;
+}
+
+/**
+ * tof_frwk_reg_write - Write a single register through the register cache
+ *
+ * @chip: tof_sensor_chip pointer
+ * @reg: the i2c register address
+ * @val: register value
+ */
+int tof_frwk_reg_write(struct tof_sensor_chip *chip, u8 reg, u8 val)
+{
+    int ret = regmap_write(chip->regmap, reg, val);
+    // cached registers hold the written value, only resets need a drop
+    if ((reg == TMF882X_STAT) || (reg == TMF882X_RESETREASON))
+        tof_regcache_invalidate(chip, reg, 1);
+    return ret;
+}
+
+static int tof_regmap_reg_read(void *context, unsigned int reg,
+                               unsigned int *val)
+{
+    u8 data;
+    int ret = tof_frwk_i2c_read(context, reg, &data, 1);
+    if (!ret)
+        *val = data;
+    return ret;
+}
+
+static int tof_regmap_reg_write(void *context, unsigned int reg,
+                                unsigned int val)
+{
+    u8 data = val;
+    return tof_i2c_raw_write(context, reg, &data, 1);
+}
+
+/* Only registers the driver owns are cached, everything the device firmware
+ * updates (status, IRQ status, command/TID, result window) is volatile.
+ */
+static bool tof_regmap_volatile_reg(struct device *dev, unsigned int reg)
+{
+    switch (reg) {
+        case TMF882X_INT_EN:
+        case TMF882X_ID:
+        case TMF882X_REV_ID:
+            return false;
+        default:
+            return true;
+    }
+}
+
+static const struct regmap_config tof_regmap_config = {
+    .reg_bits = 8,
+    .val_bits = 8,
+    .max_register = TOF_REGMAP_MAX_REG,
+    .reg_read = tof_regmap_reg_read,
+    .reg_write = tof_regmap_reg_write,
+    .volatile_reg = tof_regmap_volatile_reg,
+    .cache_type = REGCACHE_RBTREE,
+};
+
+/**
+ * tof_frwk_irq_is_polled - Whether device interrupts are polled by a thread
+ *
+ * @chip: tof_sensor_chip pointer
+ */
+bool tof_frwk_irq_is_polled(struct tof_sensor_chip *chip)
+{
+    return (chip->poll_period != 0) || !chip->pdata->gpiod_interrupt;
+}
+
+/**
+ * tof_frwk_cmd_irq_arm - Arm the command completion before issuing a command
+ *
+ * @chip: tof_sensor_chip pointer, chip->lock must be held
+ *
+ * Returns 0 if the next interrupt will signal the command completion, or
+ * -EOPNOTSUPP if the device is polled and the caller has to poll CMD_STAT
+ */
+int tof_frwk_cmd_irq_arm(struct tof_sensor_chip *chip)
+{
+    if (tof_frwk_irq_is_polled(chip))
+        return -EOPNOTSUPP;
+    reinit_completion(&chip->cmd_done);
+    WRITE_ONCE(chip->cmd_irq_armed, true);
+    return 0;
+}
+
+/**
+ * tof_frwk_irq_thread_pending - Whether the IRQ thread has not run yet
+ *
+ * @chip: tof_sensor_chip pointer
+ *
+ * The oneshot IRQ line stays masked until the IRQ thread is done, so no
+ * further interrupt (e.g. CMD_DONE) can be received until then.
+ */
+bool tof_frwk_irq_thread_pending(struct tof_sensor_chip *chip)
+{
+    return READ_ONCE(chip->irq_thread_pending);
+}
+
+/**
+ * tof_frwk_cmd_irq_wait - Wait for an interrupt after arming the completion
+ *
+ * @chip: tof_sensor_chip pointer, chip->lock must be held
+ * @timeout_us: maximum time to wait for the interrupt
+ *
+ * Returns 0 if an interrupt was received, -ETIMEDOUT otherwise. The
+ * completion stays armed until tof_frwk_cmd_irq_disarm() is called.
+ */
+int tof_frwk_cmd_irq_wait(struct tof_sensor_chip *chip, u32 timeout_us)
+{
+    unsigned long timeout = usecs_to_jiffies(timeout_us);
+    if (!wait_for_completion_timeout(&chip->cmd_done, timeout ?: 1))
+        return -ETIMEDOUT;
+    // re-arm in case the interrupt was not the command completion
+    WRITE_ONCE(chip->cmd_irq_armed, true);
+    return 0;
+}
+
+/**
+ * tof_frwk_cmd_irq_disarm - Stop signalling the command completion
+ *
+ * @chip: tof_sensor_chip pointer, chip->lock must be held
+ */
+void tof_frwk_cmd_irq_disarm(struct tof_sensor_chip *chip)
+{
+    WRITE_ONCE(chip->cmd_irq_armed, false);
+}
+
+/**
+ * tof_frwk_i2c_write_mask - Write a byte to the specified address with a given bitmask
+ *
+ * @client: the i2c client
+ * @reg: the i2c register address
+ * @val: byte to write
+ * @mask: bitmask to apply to address before writing
+ */
+static int tof_frwk_i2c_write_mask(struct tof_sensor_chip *chip, char reg,
+                                   const char *val, char mask)
+{
+    int ret;
+    u8 temp;
+
+    ret = tof_frwk_reg_read(chip, reg, &temp);
+    if (ret)
+        return ret;
+    temp &= ~mask;
+    temp |= *val;
+    return tof_frwk_reg_write(chip, reg, temp);
+}
+
+/**
+ * tof_hard_reset - use GPIO Chip Enable to reset the device
+ *
+ * @tof_chip: tof_sensor_chip pointer
+ */
+static int tof_hard_reset(struct tof_sensor_chip *chip)
+{
+    int error = 0;
+
+    (void) tof_poweroff_device(chip);
+    error = tof_open_mode(chip, TMF882X_MODE_APP);
+    if (error) {
+        dev_err(&chip->client->dev, "Error powering up device: %d\n", error);
+        return error;
+    }
+
+    return error;
+}
+
+/**
+ * tof_get_gpio_config - Get GPIO config from DT
+ *
+ * @tof_chip: tof_sensor_chip pointer
+ */
+static int tof_get_gpio_config(struct tof_sensor_chip *tof_chip)
+{
+    int error;
+    struct device *dev;
+    struct gpio_desc *gpiod;
+
+    if (!tof_chip->client)
+        return -EINVAL;
+    dev = &tof_chip->client->dev;
 
     /* Get the enable line GPIO pin number */
     gpiod = devm_gpiod_get_optional(dev, TOF_GPIO_ENABLE_NAME, GPIOD_OUT_HIGH);
@@ -2240,149 +3079,793 @@ static int tof_get_gpio_config(struct tof_sensor_chip *tof_chip)
 }
 
 /**
- * tof_ram_patch_callback - The firmware download callback
+ * tof_ram_patch - Download the cached firmware image
+ *
+ * @chip: tof_sensor_chip pointer
+ */
+static int tof_ram_patch(struct tof_sensor_chip *chip)
+{
+    int result = 0;
+    ktime_t start;
+
+    // the RAM contents are unknown until the download completes
+    chip->fw_app_valid = false;
+
+    // mode switch to the bootloader for FWDL
+    if (tmf882x_mode_switch(&chip->tof, TMF882X_MODE_BOOTLOADER)) {
+        dev_info(&chip->client->dev, "%s mode switch for FWDL failed\n", __func__);
+        tmf882x_dump_i2c_regs(tmf882x_mode_hndl(&chip->tof));
+        return -EIO;
+    }
+
+    dev_info(&chip->client->dev, "%s: Ram patch in progress...\n", __func__);
+    //Start fwdl timer
+    start = ktime_get();
+    result = tmf882x_fwdl(&chip->tof, FWDL_TYPE_SEG,
+                          chip->fw_cache, chip->fw_cache_size);
+    if (result) {
+        dev_err(&chip->client->dev, "%s: Ram patch failed: %d\n",
+                __func__, result);
+        return -EIO;
+    }
+    //Stop fwdl timer, reported in sysfs 'fwdl_time_us'
+    chip->fwdl_time_us = ktime_us_delta(ktime_get(), start);
+    dev_info(&chip->client->dev,
+            "%s: Ram patch complete, dl time: %llu us\n", __func__,
+            chip->fwdl_time_us);
+    return 0;
+}
+
+static int tof_poweroff_device(struct tof_sensor_chip *chip)
+{
+    tmf882x_close(&chip->tof);
+    if (!chip->pdata->gpiod_enable) {
+        return 0;
+    }
+    chip->fwdl_needed = true;
+    // the device loses all register contents without power
+    regcache_drop_region(chip->regmap, 0, TOF_REGMAP_MAX_REG);
+    return gpiod_direction_output(chip->pdata->gpiod_enable, 0);
+}
+
+/**
+ * tof_irq_hardirq - The primary IRQ handler
+ *
+ * @irq: interrupt number.
+ * @dev_id: private data pointer.
+ *
+ * Records the time of the interrupt assertion, before any I2C traffic or
+ * thread scheduling latency. The IRQ is oneshot, so the timestamp can not
+ * be overwritten before the threaded handler is done with it.
+ */
+static irqreturn_t tof_irq_hardirq(int irq, void *dev_id)
+{
+    struct tof_sensor_chip *tof_chip = (struct tof_sensor_chip *)dev_id;
+    tof_chip->irq_timestamp_ns = ktime_get_boottime_ns();
+    WRITE_ONCE(tof_chip->irq_thread_pending, true);
+    // a command issuer holds chip->lock and sleeps until the device is done,
+    // the IRQ thread stays masked (oneshot) until the issuer acked CMD_DONE
+    if (READ_ONCE(tof_chip->cmd_irq_armed)) {
+        WRITE_ONCE(tof_chip->cmd_irq_armed, false);
+        complete(&tof_chip->cmd_done);
+    }
+    return IRQ_WAKE_THREAD;
+}
+
+/**
+ * tof_irq_handler - The IRQ handler
+ *
+ * @irq: interrupt number.
+ * @dev_id: private data pointer.
+ */
+static irqreturn_t tof_irq_handler(int irq, void *dev_id)
+{
+    struct tof_sensor_chip *tof_chip = (struct tof_sensor_chip *)dev_id;
+    AMS_MUTEX_LOCK(&tof_chip->lock);
+    // polled I/O has no primary handler, the poll is the interrupt time
+    if (tof_chip->poll_period != 0)
+        tof_chip->irq_timestamp_ns = ktime_get_boottime_ns();
+    (void) tmf882x_process_irq(&tof_chip->tof);
+    tof_chip->irq_timestamp_ns = 0;
+    // wake up userspace (even for errors), but only if anything was queued
+    if (tof_chip->wake_pending) {
+        tof_chip->wake_pending = false;
+        wake_up_interruptible_sync(&tof_chip->fifo_wait);
+    }
+    WRITE_ONCE(tof_chip->irq_thread_pending, false);
+    AMS_MUTEX_UNLOCK(&tof_chip->lock);
+    return IRQ_HANDLED;
+}
+
+/**
+ * tof_frwk_result_irq - Note that a measurement result was read out
+ *
+ * @chip: tof_sensor_chip pointer, chip->lock must be held
+ */
+void tof_frwk_result_irq(struct tof_sensor_chip *chip)
+{
+    chip->poll.hit = true;
+}
+
+/**
+ * tof_frwk_poll_reset - Forget the learned frame period
+ *
+ * @chip: tof_sensor_chip pointer, chip->lock must be held
+ * @stats: also clear the poll statistics
+ */
+void tof_frwk_poll_reset(struct tof_sensor_chip *chip, bool stats)
+{
+    struct tof_poll_pll *pll = &chip->poll;
+
+    if (stats) {
+        memset(pll, 0, sizeof(*pll));
+        return;
+    }
+    pll->frame_ns = 0;
+    pll->last_hit_ns = 0;
+    pll->last_sys_ticks = 0;
+    pll->rejects = 0;
+    pll->hit = false;
+    pll->frame_early = false;
+}
+
+/**
+ * tof_poll_learn - Learn the frame period from the device sys_ticks
+ *
+ * @chip: tof_sensor_chip pointer, chip->lock must be held
+ * @sys_ticks: sys_ticks of a measurement result, bit 0 flags a valid value
+ */
+static void tof_poll_learn(struct tof_sensor_chip *chip, u32 sys_ticks)
+{
+    struct tof_poll_pll *pll = &chip->poll;
+    u64 sample_ns;
+
+    if (!(sys_ticks & 0x1))
+        return;
+    if (!(pll->last_sys_ticks & 0x1)) {
+        pll->last_sys_ticks = sys_ticks;
+        return;
+    }
+    sample_ns = (u64)(sys_ticks - pll->last_sys_ticks) * TOF_SYS_TICK_NS;
+    pll->last_sys_ticks = sys_ticks;
+
+    if (!pll->frame_ns && chip->tof_cfg.report_period_ms)
+        pll->frame_ns = (u64)chip->tof_cfg.report_period_ms * NSEC_PER_MSEC;
+
+    // skipped frames or a new report period, resync after a few rejects
+    if (pll->frame_ns && ((sample_ns < pll->frame_ns / 2) ||
+                          (sample_ns > pll->frame_ns + pll->frame_ns / 2))) {
+        if (++pll->rejects < TOF_POLL_MAX_REJECTS)
+            return;
+        pll->frame_ns = 0;
+    }
+    pll->rejects = 0;
+    // low pass filter, 1/8 weight for the new sample
+    pll->frame_ns = pll->frame_ns ?
+        pll->frame_ns - (pll->frame_ns >> 3) + (sample_ns >> 3) : sample_ns;
+}
+
+/**
+ * tof_poll_next - Schedule the next poll
+ *
+ * @chip: tof_sensor_chip pointer, chip->lock must be held
+ * @now: boottime of the start of the poll that just finished
+ *
+ * While locked to the frame cadence the next poll lands just after the
+ * predicted result-ready time, and creeps earlier by a fraction of the poll
+ * period every frame that was read on the first try. Early polls retry after
+ * one poll period. Without a lock the driver falls back to the poll period.
+ *
+ * Returns the boottime of the next poll
+ */
+static ktime_t tof_poll_next(struct tof_sensor_chip *chip, u64 now)
+{
+    struct tof_poll_pll *pll = &chip->poll;
+    // Poll period is interpreted in units of 100 usec
+    u64 retry_ns = (u64)chip->poll_period * 100 * NSEC_PER_USEC;
+    bool locked = pll->frame_ns && pll->last_hit_ns &&
+                  (now - pll->last_hit_ns < TOF_POLL_LOCK_FRAMES * pll->frame_ns);
+
+    pll->polls++;
+    if (pll->hit) {
+        pll->hits++;
+        pll->last_hit_ns = now;
+        if (pll->frame_ns) {
+            now += pll->frame_ns;
+            if (!pll->frame_early)
+                now -= min(retry_ns / TOF_POLL_CREEP_DIV, pll->frame_ns / 2);
+            pll->frame_early = false;
+            return ns_to_ktime(now);
+        }
+    } else if (locked) {
+        pll->early++;
+        pll->frame_early = true;
+    }
+    return ns_to_ktime(now + retry_ns);
+}
+
+static int tmf882x_poll_irq_thread(void *tof_chip)
+{
+    struct tof_sensor_chip *chip = (struct tof_sensor_chip *)tof_chip;
+    int us_sleep = 0;
+    u64 start;
+    ktime_t next;
+    AMS_MUTEX_LOCK(&chip->lock);
+    // Poll period is interpreted in units of 100 usec
+    us_sleep = chip->poll_period * 100;
+    dev_info(&chip->client->dev,
+             "Starting ToF irq polling thread, period: %u us\n", us_sleep);
+    AMS_MUTEX_UNLOCK(&chip->lock);
+    while (!kthread_should_stop()) {
+        start = ktime_get_boottime_ns();
+        (void) tof_irq_handler(0, tof_chip);
+        AMS_MUTEX_LOCK(&chip->lock);
+        next = tof_poll_next(chip, start);
+        chip->poll.hit = false;
+        AMS_MUTEX_UNLOCK(&chip->lock);
+        // hrtimer based sleep, kthread_stop() wakes us up early
+        set_current_state(TASK_INTERRUPTIBLE);
+        if (!kthread_should_stop())
+            schedule_hrtimeout_range_clock(&next, TOF_POLL_SLACK_NS,
+                                           HRTIMER_MODE_ABS, CLOCK_BOOTTIME);
+        __set_current_state(TASK_RUNNING);
+    }
+    return 0;
+}
+
+/**
+ * tof_request_irq - request IRQ for given gpio
+ *
+ * @tof_chip: tof_sensor_chip pointer
+ */
+static int tof_request_irq(struct tof_sensor_chip *tof_chip)
+{
+    int irq = tof_chip->client->irq;
+    unsigned long default_trigger =
+        irqd_get_trigger_type(irq_get_irq_data(irq));
+    dev_info(&tof_chip->client->dev,
+             "irq: %d, trigger_type: %lu", irq, default_trigger);
+    return devm_request_threaded_irq(&tof_chip->client->dev,
+                                     tof_chip->client->irq,
+                                     tof_irq_hardirq, tof_irq_handler,
+                                     default_trigger |
+                                     IRQF_SHARED     |
+                                     IRQF_ONESHOT,
+                                     tof_chip->client->name,
+                                     tof_chip);
+}
+
+static struct tof_frame_ring *tof_ring_alloc(struct tof_reader *reader,
+                                             unsigned long size)
+{
+    struct tof_frame_ring *ring;
+    u32 slot_size = ALIGN(sizeof(struct tmf882x_msg), SMP_CACHE_BYTES);
+
+    // the ring is pinned kernel memory, bound it like a reader FIFO
+    if ((size < (PAGE_SIZE + TMF882X_RING_MIN_SLOTS * slot_size)) ||
+        (size > TOF_RING_MAX_SIZE))
+        return ERR_PTR(-EINVAL);
+    ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+    if (!ring)
+        return ERR_PTR(-ENOMEM);
+    // vmalloc_user memory is zeroed and can be remapped to userspace
+    ring->ctrl = vmalloc_user(size);
+    if (!ring->ctrl) {
+        kfree(ring);
+        return ERR_PTR(-ENOMEM);
+    }
+    ring->reader = reader;
+    ring->slots = (u8 *)ring->ctrl + PAGE_SIZE;
+    ring->slot_size = slot_size;
+    ring->num_slots = (size - PAGE_SIZE) / slot_size;
+    atomic_set(&ring->map_count, 1);
+
+    ring->ctrl->magic = TMF882X_RING_MAGIC;
+    ring->ctrl->slot_size = ring->slot_size;
+    ring->ctrl->num_slots = ring->num_slots;
+    ring->ctrl->data_offset = PAGE_SIZE;
+    return ring;
+}
+
+static void tof_ring_free(struct tof_frame_ring *ring)
+{
+    vfree(ring->ctrl);
+    kfree(ring);
+}
+
+/* Length of a message as queued for a reader, including its timestamp */
+static u32 tof_reader_msg_len(struct tof_reader *reader,
+                              struct tmf882x_msg *msg)
+{
+    if (reader->msg_flags & TMF882X_MSG_FLAG_TIMESTAMP)
+        return msg->hdr.msg_len + TMF882X_MSG_TIMESTAMP_SIZE;
+    return msg->hdr.msg_len;
+}
+
+/**
+ * tof_ring_push - copy a message into the next free slot of the frame ring
+ *
+ * @ring: frame ring, caller must hold chip->ring_lock
+ * @msg: message to publish
+ * @timestamp_ns: timestamp appended for readers that asked for it
+ *
+ * Only the kernel-private copies of head/num_slots/slot_size are trusted,
+ * userspace may scribble on the shared control block. Bulk data can not use
+ * the slots reserved for measurement results, like the FIFO lanes.
+ */
+static int tof_ring_push(struct tof_frame_ring *ring, struct tmf882x_msg *msg,
+                         u64 timestamp_ns)
+{
+    u32 tail = smp_load_acquire(&ring->ctrl->tail);
+    u32 limit = ring->num_slots;
+    u32 len = tof_reader_msg_len(ring->reader, msg);
+    u8 *slot;
+
+    if (len > ring->slot_size)
+        return -EINVAL;
+    if (tof_msg_lane(msg) == TOF_LANE_BULK)
+        limit -= DIV_ROUND_UP(ring->num_slots, TOF_RING_RESULT_RESERVE);
+    if ((ring->head - tail) >= limit) {
+        ring->dropped++;
+        WRITE_ONCE(ring->ctrl->dropped, ring->dropped);
+        return -ENOSPC;
+    }
+    slot = ring->slots + (ring->head % ring->num_slots) * ring->slot_size;
+    memcpy(slot, msg->msg_buf, msg->hdr.msg_len);
+    if (len > msg->hdr.msg_len) {
+        ((struct tmf882x_msg_header *)slot)->msg_len = len;
+        memcpy(slot + msg->hdr.msg_len, &timestamp_ns, sizeof(timestamp_ns));
+    }
+    ring->head++;
+    // make the slot contents visible before the new head
+    smp_store_release(&ring->ctrl->head, ring->head);
+    return 0;
+}
+
+/**
+ * tof_reader_queued - number of messages queued for a reader
+ *
+ * @reader: reader to check
+ * @bytes: returns the number of bytes queued
+ * @full: returns true if another max-size message may not fit
+ */
+static u32 tof_reader_queued(struct tof_reader *reader, u32 *bytes, bool *full)
+{
+    struct tof_sensor_chip *chip = reader->chip;
+    struct tof_frame_ring *ring;
+    u32 msgs = 0;
+    u32 cnt;
+    int i;
+
+    *bytes = 0;
+    *full = false;
+    spin_lock(&chip->ring_lock);
+    ring = reader->ring;
+    if (ring) {
+        cnt = min(ring->head - READ_ONCE(ring->ctrl->tail), ring->num_slots);
+        msgs = cnt;
+        *bytes = cnt * ring->slot_size;
+        *full = (cnt == ring->num_slots);
+    }
+    spin_unlock(&chip->ring_lock);
+    if (ring)
+        return msgs;
+
+    for (i = 0; i < TOF_NUM_LANES; i++) {
+        msgs += reader->lanes[i].msg_count;
+        *bytes += kfifo_len(&reader->lanes[i].fifo);
+        if (kfifo_avail(&reader->lanes[i].fifo) < sizeof(struct tmf882x_msg))
+            *full = true;
+    }
+    return msgs;
+}
+
+/**
+ * tof_reader_ready - check if a reader reached its low-watermark
+ *
+ * @reader: reader to check
+ *
+ * A reader is ready once its message count or byte count watermark is met,
+ * once the watermark timer expired, or once its FIFO is about to overflow.
+ * Without any watermark set a reader is ready with one queued message.
+ */
+static bool tof_reader_ready(struct tof_reader *reader)
+{
+    struct tmf882x_watermark *wm = &reader->wm;
+    u32 bytes;
+    bool full;
+    u32 msgs = tof_reader_queued(reader, &bytes, &full);
+
+    if (!msgs)
+        return false;
+    if (full || READ_ONCE(reader->wm_expired))
+        return true;
+    if (!wm->msg_count && !wm->bytes)
+        return true;
+    if (wm->msg_count && (msgs >= wm->msg_count))
+        return true;
+    if (wm->bytes && (bytes >= wm->bytes))
+        return true;
+    return false;
+}
+
+static void tof_reader_wm_timeout(struct timer_list *t)
+{
+    struct tof_reader *reader = timer_container_of(reader, t, wm_timer);
+    WRITE_ONCE(reader->wm_expired, true);
+    wake_up_interruptible(&reader->chip->fifo_wait);
+}
+
+/* Start the max-latency timer with the first message queued for a reader */
+static void tof_reader_wm_arm(struct tof_reader *reader)
+{
+    u32 bytes;
+    bool full;
+    if (!reader->wm.timeout_ms || reader->wm_expired ||
+        timer_pending(&reader->wm_timer))
+        return;
+    if (!tof_reader_queued(reader, &bytes, &full))
+        return;
+    mod_timer(&reader->wm_timer,
+              jiffies + msecs_to_jiffies(reader->wm.timeout_ms));
+}
+
+/* Stop the max-latency timer once a reader has nothing queued anymore */
+static void tof_reader_wm_reset(struct tof_reader *reader)
+{
+    timer_delete(&reader->wm_timer);
+    WRITE_ONCE(reader->wm_expired, false);
+}
+
+/* Remove the next message of @len bytes from a lane */
+static void tof_lane_skip(struct tof_fifo_lane *lane, size_t len)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,10,0)
+    kfifo_skip_count(&lane->fifo, len);
+#else
+    u8 scratch[64];
+    unsigned int chunk;
+
+    // no kfifo_skip_count() yet, drain through a scratch buffer instead
+    while (len) {
+        chunk = min_t(size_t, len, sizeof(scratch));
+        if (!kfifo_out(&lane->fifo, scratch, chunk))
+            break;
+        len -= chunk;
+    }
+#endif
+    lane->msg_count--;
+    lane->out_seq++;
+}
+
+/**
+ * tof_lane_put - copy a message into a reader lane
+ *
+ * @reader: reader the lane belongs to
+ * @lane: lane to queue the message to
+ * @msg: message to queue
+ * @timestamp_ns: timestamp appended for readers that asked for it
+ *
+ * Returns 0 on success, -ENOSPC if the message does not fit
+ */
+static int tof_lane_put(struct tof_reader *reader, struct tof_fifo_lane *lane,
+                        struct tmf882x_msg *msg, u64 timestamp_ns)
+{
+    struct tmf882x_msg_header hdr = msg->hdr;
+    u32 len = tof_reader_msg_len(reader, msg);
+
+    if (kfifo_avail(&lane->fifo) < len)
+        return -ENOSPC;
+    hdr.msg_len = len;
+    kfifo_in(&lane->fifo, (u8 *)&hdr, sizeof(hdr));
+    kfifo_in(&lane->fifo, &msg->msg_buf[sizeof(hdr)],
+             msg->hdr.msg_len - sizeof(hdr));
+    if (len > msg->hdr.msg_len)
+        kfifo_in(&lane->fifo, (u8 *)&timestamp_ns, sizeof(timestamp_ns));
+    lane->msg_count++;
+    return 0;
+}
+
+static void tof_reader_drop_oldest(struct tof_reader *reader,
+                                   struct tof_fifo_lane *lane)
+{
+    tof_lane_skip(lane, tof_lane_next_msg_size(lane));
+    reader->dropped++;
+}
+
+/**
+ * tof_reader_make_room - apply the overflow policy until a message fits
+ *
+ * @reader: reader whose FIFO is checked
+ * @lane: lane of the reader the message is queued to
+ * @len: length of the message to queue
+ * @timestamp_ns: timestamp of the error message queued on a flush
+ *
+ * The overflow policy only ever discards messages of the given lane, so
+ * bulk data can never evict measurement results.
+ *
+ * Returns 0 if the message can be queued, -ENOSPC if it has to be dropped
+ */
+static int tof_reader_make_room(struct tof_reader *reader,
+                                struct tof_fifo_lane *lane, size_t len,
+                                u64 timestamp_ns)
+{
+    struct tof_sensor_chip *chip = reader->chip;
+    struct tof_fifo_lane *err_lane = &reader->lanes[TOF_LANE_RESULT];
+    struct tmf882x_msg_error err;
+
+    if (kfifo_avail(&lane->fifo) >= len)
+        return 0;
+
+    switch (chip->overflow_policy) {
+        case TOF_OVERFLOW_DROP_NEWEST:
+            if (chip->driver_debug == 1)
+                dev_err(&chip->client->dev,
+                        "Error: Message buffer is full, dropping message.\n");
+            reader->dropped++;
+            return -ENOSPC;
+        case TOF_OVERFLOW_DROP_OLDEST:
+            if (chip->driver_debug == 1)
+                dev_err(&chip->client->dev,
+                        "Error: Message buffer is full, dropping oldest.\n");
+            while ((kfifo_avail(&lane->fifo) < len) && lane->msg_count)
+                tof_reader_drop_oldest(reader, lane);
+            break;
+        case TOF_OVERFLOW_FLUSH:
+        default:
+            if (chip->driver_debug == 1)
+                dev_err(&chip->client->dev,
+                        "Error: Message buffer is full, clearing buffer.\n");
+            reader->dropped += lane->msg_count;
+            tof_lane_reset(lane);
+            // let the reader know its buffer was flushed
+            TOF_SET_ERR_MSG(&err, ERR_BUF_OVERFLOW);
+            (void) tof_lane_put(reader, err_lane, (struct tmf882x_msg *)&err,
+                                timestamp_ns);
+            break;
+    }
+    return (kfifo_avail(&lane->fifo) >= len) ? 0 : -ENOSPC;
+}
+
+static int tof_reader_queue_msg(struct tof_reader *reader,
+                                struct tmf882x_msg *msg, u64 timestamp_ns)
+{
+    struct tof_sensor_chip *chip = reader->chip;
+    struct tof_fifo_lane *lane = &reader->lanes[tof_msg_lane(msg)];
+    unsigned int fifo_len;
+    int result;
+
+    // skip message types this reader is not subscribed to
+    if ((msg->hdr.msg_id >= 32) ||
+        !(reader->msg_mask & TMF882X_MSG_MASK(msg->hdr.msg_id)))
+        return 0;
+
+    // frames go to the mmap() frame ring instead of the FIFO while mapped
+    spin_lock(&chip->ring_lock);
+    if (reader->ring) {
+        result = tof_ring_push(reader->ring, msg, timestamp_ns);
+        if (result)
+            reader->dropped++;
+        spin_unlock(&chip->ring_lock);
+        if (result && (chip->driver_debug == 1))
+            dev_err(&chip->client->dev,
+                    "Error: frame ring is full, dropping message.\n");
+        return result ? -1 : 0;
+    }
+    spin_unlock(&chip->ring_lock);
+
+    // handle FIFO overflow case
+    if (tof_reader_make_room(reader, lane, tof_reader_msg_len(reader, msg),
+                             timestamp_ns))
+        return -1;
+
+    result = tof_lane_put(reader, lane, msg, timestamp_ns);
+    if (result) {
+        dev_err(&chip->client->dev,
+                "Error: queueing ToF output message.\n");
+    }
+    if (chip->driver_debug == 2) {
+        fifo_len = kfifo_len(&lane->fifo);
+        dev_info(&chip->client->dev,
+                "New fifo len: %u, fifo utilization: %u%%\n",
+                fifo_len, (1000*fifo_len/kfifo_size(&lane->fifo))/10);
+    }
+    return result ? -1 : 0;
+}
+
+static int tof_readers_queue_msg(struct tof_sensor_chip *chip,
+                                 struct tmf882x_msg *msg, u64 timestamp_ns)
+{
+    struct tof_reader *reader;
+    int ret = 0;
+
+    // fan out to every open file of the ToF char device
+    list_for_each_entry(reader, &chip->readers, node) {
+        spin_lock(&reader->fifo_lock);
+        if (tof_reader_queue_msg(reader, msg, timestamp_ns))
+            ret = -1;
+        tof_reader_wm_arm(reader);
+        // only wake up readers that reached their watermark
+        if (tof_reader_ready(reader))
+            chip->wake_pending = true;
+        spin_unlock(&reader->fifo_lock);
+    }
+    return ret;
+}
+
+/* Fill level in percent of the fullest bulk lane (or frame ring) */
+static u32 tof_readers_bulk_fill(struct tof_sensor_chip *chip)
+{
+    struct tof_reader *reader;
+    struct tof_fifo_lane *lane;
+    u32 fill, max_fill = 0;
+
+    list_for_each_entry(reader, &chip->readers, node) {
+        spin_lock(&chip->ring_lock);
+        if (reader->ring) {
+            fill = reader->ring->head - READ_ONCE(reader->ring->ctrl->tail);
+            fill = 100 * min(fill, reader->ring->num_slots) /
+                   reader->ring->num_slots;
+        } else {
+            lane = &reader->lanes[TOF_LANE_BULK];
+            fill = 100 * kfifo_len(&lane->fifo) / kfifo_size(&lane->fifo);
+        }
+        spin_unlock(&chip->ring_lock);
+        max_fill = max(max_fill, fill);
+    }
+    return max_fill;
+}
+
+/**
+ * tof_hist_backpressure - decimate histograms while readers fall behind
+ *
+ * @chip: tof_sensor_chip pointer
+ * @msg: histogram message about to be published
+ * @timestamp_ns: timestamp of the histogram message
+ *
+ * Decimation is switched on when the fullest bulk lane crosses the high-water
+ * mark, and off again once it drains below the low-water mark. Readers are
+ * notified of every change with a STATUS_HIST_DECIMATION status message.
+ *
+ * Returns true if the histogram should be dropped
+ */
+static bool tof_hist_backpressure(struct tof_sensor_chip *chip,
+                                  struct tmf882x_msg *msg, u64 timestamp_ns)
+{
+    struct tmf882x_msg_status status;
+    bool decimate = chip->hist_decimating;
+    u32 fill;
+
+    if (chip->hist_decimation > 1) {
+        fill = tof_readers_bulk_fill(chip);
+        if (!decimate && (fill >= chip->hist_high_water))
+            decimate = true;
+        else if (decimate && (fill <= chip->hist_low_water))
+            decimate = false;
+    } else {
+        decimate = false;
+    }
+
+    if (decimate != chip->hist_decimating) {
+        chip->hist_decimating = decimate;
+        if (chip->driver_debug)
+            dev_info(&chip->client->dev, "Histogram decimation %s\n",
+                     decimate ? "on" : "off");
+        TOF_SET_STATUS_MSG(&status, STATUS_HIST_DECIMATION,
+                           decimate ? chip->hist_decimation : 0);
+        (void) tof_readers_queue_msg(chip, (struct tmf882x_msg *)&status,
+                                     timestamp_ns);
+    }
+
+    // keep whole captures, sub-captures share the capture number
+    return decimate && (msg->hist_msg.capture_num % chip->hist_decimation);
+}
+
+/**
+ * tof_frwk_irq_timestamp - Timestamp of the interrupt being handled
+ *
+ * @chip: tof_sensor_chip pointer, chip->lock must be held
+ *
+ * Returns the boottime of the interrupt being handled, or 'now' outside of it
+ */
+u64 tof_frwk_irq_timestamp(struct tof_sensor_chip *chip)
+{
+    return chip->irq_timestamp_ns ? chip->irq_timestamp_ns :
+                                    ktime_get_boottime_ns();
+}
+
+/**
+ * tof_frwk_queue_msg_at - Publish a message with a given timestamp
  *
- * @cfg: the firmware cfg structure
- * @ctx: private data pointer to struct tof_sensor_chip
+ * @chip: tof_sensor_chip pointer, chip->lock must be held
+ * @msg: message to publish
+ * @timestamp_ns: boottime of the interrupt the message was received with
  */
-static void tof_ram_patch_callback(const struct firmware *cfg, void *ctx)
+int tof_frwk_queue_msg_at(struct tof_sensor_chip *chip,
+                          struct tmf882x_msg *msg, u64 timestamp_ns)
 {
-    struct tof_sensor_chip *chip = ctx;
-    int result = 0;
-    u64 fwdl_time = 0;
-    struct timespec64 start_ts = {0}, end_ts = {0};
-    if (!chip) {
-        pr_err("AMS-TOF Error: Ram patch callback NULL context pointer.\n");
-    }
+    if ((msg->hdr.msg_id == ID_MEAS_RESULTS) && (chip->poll_period != 0))
+        tof_poll_learn(chip, msg->meas_result_msg.sys_ticks);
 
-    if (!cfg) {
-        dev_warn(&chip->client->dev, "%s: Warning, firmware not available.\n", __func__);
-        goto err_fwdl;
-    }
+    tof_publish_input_events(chip, msg); // publish any input events
 
-    // mode switch to the bootloader for FWDL
-    if (tmf882x_mode_switch(&chip->tof, TMF882X_MODE_BOOTLOADER)) {
-        dev_info(&chip->client->dev, "%s mode switch for FWDL failed\n", __func__);
-        tmf882x_dump_i2c_regs(tmf882x_mode_hndl(&chip->tof));
-        goto err_fwdl;
-    }
+    if ((msg->hdr.msg_id == ID_HISTOGRAM) &&
+        tof_hist_backpressure(chip, msg, timestamp_ns))
+        return 0;
 
-    dev_info(&chip->client->dev, "%s: Ram patch in progress...\n", __func__);
-    //Start fwdl timer
-    ktime_get_real_ts64(&start_ts);
-    result = tmf882x_fwdl(&chip->tof, FWDL_TYPE_HEX, cfg->data, cfg->size);
-    if (result)
-        goto err_fwdl;
-    //Stop fwdl timer
-    ktime_get_real_ts64(&end_ts);
-    //time in ms
-    fwdl_time = timespec64_sub(end_ts, start_ts).tv_nsec / 1000000;
-    dev_info(&chip->client->dev,
-            "%s: Ram patch complete, dl time: %llu ms\n", __func__, fwdl_time);
-err_fwdl:
-    release_firmware(cfg);
-    complete_all(&chip->ram_patch_in_progress);
+    return tof_readers_queue_msg(chip, msg, timestamp_ns);
 }
 
-static int tof_poweroff_device(struct tof_sensor_chip *chip)
+int tof_frwk_queue_msg(struct tof_sensor_chip *chip, struct tmf882x_msg *msg)
 {
-    tmf882x_close(&chip->tof);
-    if (!chip->pdata->gpiod_enable) {
-        return 0;
-    }
-    chip->fwdl_needed = true;
-    return gpiod_direction_output(chip->pdata->gpiod_enable, 0);
+    return tof_frwk_queue_msg_at(chip, msg, tof_frwk_irq_timestamp(chip));
 }
 
 /**
- * tof_irq_handler - The IRQ handler
+ * tof_decode_work - Decode and publish data messages off the IRQ thread
  *
- * @irq: interrupt number.
- * @dev_id: private data pointer.
+ * @work: decode_work of the tof_sensor_chip
+ *
+ * Decoding runs without chip->lock, so the IRQ thread can read out the next
+ * frame from the device meanwhile. Publishing is serialized with the IRQ
+ * thread under chip->lock to keep the output in order with the messages the
+ * IRQ thread queues itself, and because the reader list and the input event,
+ * poll and backpressure state it updates are all protected by chip->lock.
  */
-static irqreturn_t tof_irq_handler(int irq, void *dev_id)
+static void tof_decode_work(struct kthread_work *work)
 {
-    struct tof_sensor_chip *tof_chip = (struct tof_sensor_chip *)dev_id;
-    AMS_MUTEX_LOCK(&tof_chip->lock);
-    (void) tmf882x_process_irq(&tof_chip->tof);
-    // wake up userspace even for errors
-    wake_up_interruptible_sync(&tof_chip->fifo_wait);
-    AMS_MUTEX_UNLOCK(&tof_chip->lock);
-    return IRQ_HANDLED;
-}
+    struct tof_sensor_chip *chip =
+        container_of(work, struct tof_sensor_chip, decode_work);
+    int rc;
 
-static int tmf882x_poll_irq_thread(void *tof_chip)
-{
-    struct tof_sensor_chip *chip = (struct tof_sensor_chip *)tof_chip;
-    int us_sleep = 0;
     AMS_MUTEX_LOCK(&chip->lock);
-    // Poll period is interpreted in units of 100 usec
-    us_sleep = chip->poll_period * 100;
-    dev_info(&chip->client->dev,
-             "Starting ToF irq polling thread, period: %u us\n", us_sleep);
-    AMS_MUTEX_UNLOCK(&chip->lock);
-    while (!kthread_should_stop()) {
-        (void) tof_irq_handler(0, tof_chip);
-        AMS_MUTEX_LOCK(&chip->lock);
-        // Poll period is interpreted in units of 100 usec
-        us_sleep = chip->poll_period * 100;
+    do {
+        if (chip->driver_remove)
+            break;
+        // publish the previous frame and claim the next one
+        (void) tmf882x_publish(&chip->tof);
+        if (chip->wake_pending) {
+            chip->wake_pending = false;
+            wake_up_interruptible_sync(&chip->fifo_wait);
+        }
+        chip->decoding = true;
+        reinit_completion(&chip->decode_done);
         AMS_MUTEX_UNLOCK(&chip->lock);
-        usleep_range(us_sleep, us_sleep + us_sleep/10);
-    }
-    return 0;
+
+        rc = tmf882x_decode(&chip->tof);
+        complete_all(&chip->decode_done);
+
+        AMS_MUTEX_LOCK(&chip->lock);
+        chip->decoding = false;
+    } while (rc > 0);
+    AMS_MUTEX_UNLOCK(&chip->lock);
 }
 
 /**
- * tof_request_irq - request IRQ for given gpio
+ * tof_frwk_schedule_decode - Kick the decode worker
  *
- * @tof_chip: tof_sensor_chip pointer
+ * @chip: tof_sensor_chip pointer, chip->lock must be held
+ *
+ * Returns 0 if the worker will run, or -ENODEV if the driver is going away
  */
-static int tof_request_irq(struct tof_sensor_chip *tof_chip)
+int tof_frwk_schedule_decode(struct tof_sensor_chip *chip)
 {
-    int irq = tof_chip->client->irq;
-    unsigned long default_trigger =
-        irqd_get_trigger_type(irq_get_irq_data(irq));
-    dev_info(&tof_chip->client->dev,
-             "irq: %d, trigger_type: %lu", irq, default_trigger);
-    return devm_request_threaded_irq(&tof_chip->client->dev,
-                                     tof_chip->client->irq,
-                                     NULL, tof_irq_handler,
-                                     default_trigger |
-                                     IRQF_SHARED     |
-                                     IRQF_ONESHOT,
-                                     tof_chip->client->name,
-                                     tof_chip);
+    if (chip->driver_remove)
+        return -ENODEV;
+    // a single worker thread, the work never runs twice at once
+    kthread_queue_work(chip->decode_worker, &chip->decode_work);
+    return 0;
 }
 
-int tof_frwk_queue_msg(struct tof_sensor_chip *chip, struct tmf882x_msg *msg)
+/**
+ * tof_frwk_decode_sync - Wait for an in-flight decode to finish
+ *
+ * @chip: tof_sensor_chip pointer, chip->lock must be held
+ */
+void tof_frwk_decode_sync(struct tof_sensor_chip *chip)
 {
-    unsigned int fifo_len;
-    int result = kfifo_in(&chip->fifo_out, msg->msg_buf, msg->hdr.msg_len);
-    struct tmf882x_msg_error err;
-
-    tof_publish_input_events(chip, msg); // publish any input events
-
-    // handle FIFO overflow case
-    if (result != msg->hdr.msg_len) {
-        TOF_SET_ERR_MSG(&err, ERR_BUF_OVERFLOW);
-        (void) kfifo_in(&chip->fifo_out, (char *)&err, err.hdr.msg_len);
-        if (chip->driver_debug == 1)
-            dev_err(&chip->client->dev,
-                    "Error: Message buffer is full, clearing buffer.\n");
-        kfifo_reset(&chip->fifo_out);
-        result = kfifo_in(&chip->fifo_out, msg->msg_buf, msg->hdr.msg_len);
-        if (result != msg->hdr.msg_len) {
-            dev_err(&chip->client->dev,
-                    "Error: queueing ToF output message.\n");
-        }
-    }
-    if (chip->driver_debug == 2) {
-        fifo_len = kfifo_len(&chip->fifo_out);
-        dev_info(&chip->client->dev,
-                "New fifo len: %u, fifo utilization: %u%%\n",
-                fifo_len, (1000*fifo_len/kfifo_size(&chip->fifo_out))/10);
-    }
-    return (result == msg->hdr.msg_len) ? 0 : -1;
+    if (chip->decoding)
+        wait_for_completion(&chip->decode_done);
 }
 
 static void tof_idev_close(struct input_dev *dev)
@@ -2397,7 +3880,7 @@ static void tof_idev_close(struct input_dev *dev)
         if (tmf882x_stop(&chip->tof)) {
             dev_info(&dev->dev, "Error stopping measurements\n");
         }
-        kfifo_reset(&chip->fifo_out);
+        tof_fifo_flush(chip);
     }
     AMS_MUTEX_UNLOCK(&chip->lock);
     return;
@@ -2407,6 +3890,9 @@ static int tof_idev_open(struct input_dev *dev)
 {
     struct tof_sensor_chip *chip = input_get_drvdata(dev);
     int error = 0;
+    error = tof_wait_fw_ready(chip, false);
+    if (error)
+        return error;
     AMS_MUTEX_LOCK(&chip->lock);
     if (chip->open_refcnt++) {
         error = tmf882x_start(&chip->tof);
@@ -2446,19 +3932,54 @@ static int tof_idev_open(struct input_dev *dev)
     return error;
 }
 
+static void tof_reader_free(struct tof_reader *reader)
+{
+    int i;
+    timer_delete_sync(&reader->wm_timer);
+    for (i = 0; i < TOF_NUM_LANES; i++)
+        kvfree(reader->lanes[i].buf);
+    kfree(reader);
+}
+
+static struct tof_reader *tof_reader_alloc(struct tof_sensor_chip *chip)
+{
+    struct tof_reader *reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+    struct tof_fifo_lane *lane;
+    int i;
+    if (!reader)
+        return NULL;
+    spin_lock_init(&reader->fifo_lock);
+    mutex_init(&reader->read_lock);
+    timer_setup(&reader->wm_timer, tof_reader_wm_timeout, 0);
+    for (i = 0; i < TOF_NUM_LANES; i++) {
+        lane = &reader->lanes[i];
+        // large FIFOs may not be physically contiguous, use kvmalloc
+        lane->buf = kvmalloc(chip->fifo_size[i], GFP_KERNEL);
+        if (!lane->buf ||
+            kfifo_init(&lane->fifo, lane->buf, chip->fifo_size[i])) {
+            tof_reader_free(reader);
+            return NULL;
+        }
+    }
+    INIT_LIST_HEAD(&reader->node);
+    reader->chip = chip;
+    reader->msg_mask = TMF882X_MSG_MASK_ALL;
+    return reader;
+}
+
 static int tof_misc_release(struct inode *inode, struct file *f)
 {
-    struct miscdevice *misc = (struct miscdevice *)f->private_data;
-    struct tof_sensor_chip *chip =
-        container_of(misc, struct tof_sensor_chip, tof_mdev);
+    struct tof_reader *reader = (struct tof_reader *)f->private_data;
+    struct tof_sensor_chip *chip = reader->chip;
     AMS_MUTEX_LOCK(&chip->lock);
+    list_del(&reader->node);
     chip->open_refcnt--;
     if (!chip->open_refcnt) {
         dev_info(&chip->client->dev, "%s\n", __func__);
         // tof_poweroff_device(chip);
-        kfifo_reset(&chip->fifo_out);
     }
     AMS_MUTEX_UNLOCK(&chip->lock);
+    tof_reader_free(reader);
     return 0;
 }
 
@@ -2467,21 +3988,33 @@ static int tof_misc_open(struct inode *inode, struct file *f)
     struct miscdevice *misc = (struct miscdevice *)f->private_data;
     struct tof_sensor_chip *chip =
         container_of(misc, struct tof_sensor_chip, tof_mdev);
+    struct tof_reader *reader;
     int ret;
 
     if (O_WRONLY == (f->f_flags & O_ACCMODE))
         return -EACCES;
 
+    ret = tof_wait_fw_ready(chip, f->f_flags & O_NONBLOCK);
+    if (ret)
+        return ret;
+
+    reader = tof_reader_alloc(chip);
+    if (!reader)
+        return -ENOMEM;
+
     if (f->f_flags & O_NONBLOCK) {
         ret = AMS_MUTEX_TRYLOCK(&chip->lock);
         if(!ret){
             dev_info(&chip->client->dev, "Error, open would block\n");
+            tof_reader_free(reader);
             return -EWOULDBLOCK;
         }
     } else {
         AMS_MUTEX_LOCK(&chip->lock);
     }
     if (chip->open_refcnt++) {
+        list_add_tail(&reader->node, &chip->readers);
+        f->private_data = reader;
         AMS_MUTEX_UNLOCK(&chip->lock);
         return 0;
     }
@@ -2492,6 +4025,7 @@ static int tof_misc_open(struct inode *inode, struct file *f)
         dev_err(&chip->client->dev, "Chip init failed: %d\n", ret);
         chip->open_refcnt--;
         AMS_MUTEX_UNLOCK(&chip->lock);
+        tof_reader_free(reader);
         return -EIO;
     }
     ret = tof_set_default_config(chip);
@@ -2499,95 +4033,350 @@ static int tof_misc_open(struct inode *inode, struct file *f)
         dev_err(&chip->client->dev, "Error, set default config failed.\n");
         chip->open_refcnt--;
         AMS_MUTEX_UNLOCK(&chip->lock);
+        tof_reader_free(reader);
         return -EIO;
     }
+    list_add_tail(&reader->node, &chip->readers);
+    f->private_data = reader;
     AMS_MUTEX_UNLOCK(&chip->lock);
     return 0;
 }
 
+/**
+ * tof_reader_peek - copy the next message of a reader without removing it
+ *
+ * @reader: reader to peek, caller must hold reader->read_lock
+ * @buf: bounce buffer of at least @max_len bytes
+ * @max_len: maximum message length the caller can take
+ * @len: returns the length of the next message, 0 if none is queued
+ * @seq: returns the removal count of the lane, see tof_reader_consume
+ *
+ * Returns the lane of the message, NULL if no message is queued or the next
+ * message is longer than @max_len
+ */
+static struct tof_fifo_lane *tof_reader_peek(struct tof_reader *reader,
+                                             u8 *buf, size_t max_len,
+                                             u32 *len, u32 *seq)
+{
+    struct tof_fifo_lane *lane;
+
+    spin_lock(&reader->fifo_lock);
+    // results are always read before bulk data
+    lane = tof_reader_next_lane(reader);
+    *len = lane ? tof_lane_next_msg_size(lane) : 0;
+    if (!*len || (*len > max_len) ||
+        (kfifo_out_peek(&lane->fifo, buf, *len) != *len))
+        lane = NULL;
+    else
+        *seq = lane->out_seq;
+    spin_unlock(&reader->fifo_lock);
+    return lane;
+}
+
+/**
+ * tof_reader_consume - remove a message returned by tof_reader_peek
+ *
+ * @reader: reader the message was peeked from
+ * @lane: lane returned by tof_reader_peek
+ * @len: message length returned by tof_reader_peek
+ * @seq: removal count returned by tof_reader_peek
+ *
+ * The producer may have dropped the message on overflow while it was copied
+ * to userspace, in which case the lane is left alone.
+ */
+static void tof_reader_consume(struct tof_reader *reader,
+                               struct tof_fifo_lane *lane, u32 len, u32 seq)
+{
+    spin_lock(&reader->fifo_lock);
+    if (lane->out_seq == seq)
+        tof_lane_skip(lane, len);
+    if (tof_reader_fifo_is_empty(reader))
+        tof_reader_wm_reset(reader);
+    spin_unlock(&reader->fifo_lock);
+}
+
 static ssize_t tof_misc_read(struct file *f, char *buf,
                              size_t len, loff_t *off)
 {
-    struct miscdevice *misc = (struct miscdevice *)f->private_data;
-    struct tof_sensor_chip *chip =
-        container_of(misc, struct tof_sensor_chip, tof_mdev);
-    unsigned int copied = 0;
+    struct tof_reader *reader = (struct tof_reader *)f->private_data;
+    struct tof_sensor_chip *chip = reader->chip;
+    struct tof_fifo_lane *lane;
+    u8 *bounce;
+    u32 msg_size;
+    u32 seq;
     int ret = 0;
-    size_t msg_size;
     ssize_t count = 0;
 
-    if (f->f_flags & O_NONBLOCK) {
-        ret = AMS_MUTEX_TRYLOCK(&chip->lock);
-        if(!ret){
-            dev_info(&chip->client->dev, "Error, read would block\n");
-            return -EWOULDBLOCK;
-        }
-    } else {
-        AMS_MUTEX_LOCK(&chip->lock);
-    }
+    // messages are only taken out of the FIFO once userspace has them
+    bounce = kmalloc(sizeof(struct tmf882x_msg), GFP_KERNEL);
+    if (!bounce)
+        return -ENOMEM;
 
-    // sleep for more data
-    while ( kfifo_is_empty(&chip->fifo_out) ) {
+    // the producer never takes read_lock, a stalled copy only blocks us
+    AMS_MUTEX_LOCK(&reader->read_lock);
+
+    // sleep for more data, blocking reads wait for the watermark
+    while ( tof_reader_fifo_is_empty(reader) ||
+            (!(f->f_flags & O_NONBLOCK) && !tof_reader_ready(reader)) ) {
+        // frames of a mapped reader are only published in its frame ring,
+        // drain what was queued before the mapping regardless of watermark
+        if (READ_ONCE(reader->ring)) {
+            if (!tof_reader_fifo_is_empty(reader))
+                break;
+            count = -EBUSY;
+            goto out;
+        }
         if (f->f_flags & O_NONBLOCK) {
-            AMS_MUTEX_UNLOCK(&chip->lock);
-            return -ENODATA;
+            count = -ENODATA;
+            goto out;
         }
-        AMS_MUTEX_UNLOCK(&chip->lock);
         ret = wait_event_interruptible(chip->fifo_wait,
-                                       (!kfifo_is_empty(&chip->fifo_out) ||
+                                       (tof_reader_ready(reader) ||
                                         chip->driver_remove));
-        if (ret) return ret;
-        else if (chip->driver_remove) return 0;
-        AMS_MUTEX_LOCK(&chip->lock);
-    }
-
-    count = 0;
-    msg_size = tof_fifo_next_msg_size(chip);
-    if (len < msg_size) {
-        AMS_MUTEX_UNLOCK(&chip->lock);
-        return -EINVAL;
+        if (ret || chip->driver_remove) {
+            count = ret;
+            goto out;
+        }
     }
 
-    do {
-        ret = kfifo_to_user(&chip->fifo_out, &buf[count], msg_size, &copied);
-        if (ret) {
-            dev_err(&chip->client->dev, "Error (%d), reading from fifo\n", ret);
-            AMS_MUTEX_UNLOCK(&chip->lock);
-            return -EIO;
+    while (count < len) {
+        lane = tof_reader_peek(reader, bounce,
+                               min_t(size_t, len - count,
+                                     sizeof(struct tmf882x_msg)),
+                               &msg_size, &seq);
+        if (!lane) {
+            // the user buffer must fit at least the next message
+            if (!count && msg_size)
+                count = -EINVAL;
+            break;
+        }
+        // on a fault the message stays queued
+        if (copy_to_user(&buf[count], bounce, msg_size)) {
+            if (!count)
+                count = -EFAULT;
+            break;
         }
-        count += copied;
-        msg_size = tof_fifo_next_msg_size(chip);
-        if (!msg_size) break;
-    } while (msg_size < (len - count));
+        tof_reader_consume(reader, lane, msg_size, seq);
+        count += msg_size;
+    }
 
-    AMS_MUTEX_UNLOCK(&chip->lock);
+out:
+    AMS_MUTEX_UNLOCK(&reader->read_lock);
+    kfree(bounce);
     return count;
 }
 
 static unsigned int tof_misc_poll(struct file *f,
                                   struct poll_table_struct *wait)
 {
-    struct miscdevice *misc = (struct miscdevice *)f->private_data;
-    struct tof_sensor_chip *chip =
-        container_of(misc, struct tof_sensor_chip, tof_mdev);
+    struct tof_reader *reader = (struct tof_reader *)f->private_data;
+    struct tof_sensor_chip *chip = reader->chip;
+
+    u32 bytes;
+    bool full;
 
     poll_wait(f, &chip->fifo_wait, wait);
-    if (!kfifo_is_empty(&chip->fifo_out))
+    if (tof_reader_ready(reader))
         return POLLIN | POLLRDNORM;
+    // frame ring consumers drain without read(), restart the timer here
+    if (!tof_reader_queued(reader, &bytes, &full) && reader->wm_expired)
+        tof_reader_wm_reset(reader);
+    return 0;
+}
+
+static void tof_ring_vm_open(struct vm_area_struct *vma)
+{
+    struct tof_frame_ring *ring = vma->vm_private_data;
+    atomic_inc(&ring->map_count);
+}
+
+static void tof_ring_vm_close(struct vm_area_struct *vma)
+{
+    struct tof_frame_ring *ring = vma->vm_private_data;
+    struct tof_reader *reader = ring->reader;
+    struct tof_sensor_chip *chip = reader->chip;
+
+    if (!atomic_dec_and_test(&ring->map_count))
+        return;
+    // last mapping is gone, frames go back to the FIFO
+    spin_lock(&chip->ring_lock);
+    reader->ring = NULL;
+    spin_unlock(&chip->ring_lock);
+    tof_ring_free(ring);
+}
+
+static const struct vm_operations_struct tof_ring_vm_ops = {
+    .open  = tof_ring_vm_open,
+    .close = tof_ring_vm_close,
+};
+
+/**
+ * tof_misc_mmap - map the frame ring of this open file into userspace
+ *
+ * The ring is allocated to fit the requested length, and only one ring can
+ * be mapped per open file. While mapped, the messages of this open file are
+ * published in the ring instead of the FIFO read by tof_misc_read.
+ */
+static int tof_misc_mmap(struct file *f, struct vm_area_struct *vma)
+{
+    struct tof_reader *reader = (struct tof_reader *)f->private_data;
+    struct tof_sensor_chip *chip = reader->chip;
+    struct tof_frame_ring *ring;
+    int ret;
+
+    if (vma->vm_pgoff)
+        return -EINVAL;
+
+    ring = tof_ring_alloc(reader, vma->vm_end - vma->vm_start);
+    if (IS_ERR(ring))
+        return PTR_ERR(ring);
+
+    spin_lock(&chip->ring_lock);
+    if (reader->ring) {
+        spin_unlock(&chip->ring_lock);
+        tof_ring_free(ring);
+        return -EBUSY;
+    }
+    reader->ring = ring;
+    spin_unlock(&chip->ring_lock);
+
+    ret = remap_vmalloc_range(vma, ring->ctrl, 0);
+    if (ret) {
+        spin_lock(&chip->ring_lock);
+        reader->ring = NULL;
+        spin_unlock(&chip->ring_lock);
+        tof_ring_free(ring);
+        return ret;
+    }
+    vma->vm_ops = &tof_ring_vm_ops;
+    vma->vm_private_data = ring;
+    dev_info(&chip->client->dev, "Frame ring mapped, %u slots of %u bytes\n",
+             ring->num_slots, ring->slot_size);
+    return 0;
+}
+
+static bool tof_reader_batch_ready(struct tof_reader *reader, u32 min_frames)
+{
+    u32 bytes;
+    bool full;
+    u32 msgs = tof_reader_queued(reader, &bytes, &full);
+    return msgs && ((msgs >= min_frames) || full);
+}
+
+/**
+ * tof_misc_read_batch - TMF882X_IOCREADBATCH handler
+ *
+ * @f: file pointer of the reader
+ * @arg: userspace struct tmf882x_read_batch
+ *
+ * Like tof_misc_read, but waits for a minimum number of messages with a
+ * timeout and returns the message boundaries in a descriptor array.
+ */
+static long tof_misc_read_batch(struct file *f,
+                                struct tmf882x_read_batch __user *arg)
+{
+    struct tof_reader *reader = (struct tof_reader *)f->private_data;
+    struct tof_sensor_chip *chip = reader->chip;
+    struct tmf882x_read_batch batch;
+    struct tmf882x_frame_desc desc;
+    struct tmf882x_frame_desc __user *descs;
+    struct tof_fifo_lane *lane;
+    char __user *buf;
+    u8 *bounce;
+    u32 min_frames;
+    u32 len;
+    u32 seq;
+    long timeout;
+    long ret = 0;
+
+    if (copy_from_user(&batch, arg, sizeof(batch)))
+        return -EFAULT;
+    if (!batch.max_frames)
+        return -EINVAL;
+    // frames of a mapped reader are only published in its frame ring
+    if (READ_ONCE(reader->ring))
+        return -EBUSY;
+    descs = u64_to_user_ptr(batch.descs);
+    buf = u64_to_user_ptr(batch.buf);
+    min_frames = clamp_t(u32, batch.min_frames, 1, batch.max_frames);
+    if (f->f_flags & O_NONBLOCK)
+        timeout = 0;
+    else if (batch.timeout_ms < 0)
+        timeout = MAX_SCHEDULE_TIMEOUT;
+    else
+        timeout = msecs_to_jiffies(batch.timeout_ms);
+
+    // messages are only taken out of the FIFO once userspace has them
+    bounce = kmalloc(sizeof(struct tmf882x_msg), GFP_KERNEL);
+    if (!bounce)
+        return -ENOMEM;
+
+    // the producer never takes read_lock, a stalled copy only blocks us
+    AMS_MUTEX_LOCK(&reader->read_lock);
+    while (timeout && !tof_reader_batch_ready(reader, min_frames)) {
+        timeout = wait_event_interruptible_timeout(chip->fifo_wait,
+                      (tof_reader_batch_ready(reader, min_frames) ||
+                       chip->driver_remove),
+                      timeout);
+        if (timeout < 0 || chip->driver_remove) {
+            AMS_MUTEX_UNLOCK(&reader->read_lock);
+            kfree(bounce);
+            return (timeout < 0) ? timeout : -ENODEV;
+        }
+    }
+
+    batch.num_frames = 0;
+    batch.bytes = 0;
+    while (batch.num_frames < batch.max_frames) {
+        lane = tof_reader_peek(reader, bounce,
+                               min_t(u32, batch.buf_len - batch.bytes,
+                                     sizeof(struct tmf882x_msg)),
+                               &len, &seq);
+        if (!lane) {
+            if (!batch.num_frames && len)
+                ret = -EINVAL;
+            break;
+        }
+        desc.offset = batch.bytes;
+        desc.len = len;
+        desc.msg_id = ((struct tmf882x_msg_header *)bounce)->msg_id;
+        // on a fault the message stays queued, frames already copied are
+        // still reported
+        if (copy_to_user(&buf[batch.bytes], bounce, len) ||
+            copy_to_user(&descs[batch.num_frames], &desc, sizeof(desc))) {
+            if (!batch.num_frames)
+                ret = -EFAULT;
+            break;
+        }
+        tof_reader_consume(reader, lane, len, seq);
+        batch.bytes += len;
+        batch.num_frames++;
+    }
+    AMS_MUTEX_UNLOCK(&reader->read_lock);
+    kfree(bounce);
+
+    if (ret)
+        return ret;
+    if (copy_to_user(arg, &batch, sizeof(batch)))
+        return -EFAULT;
     return 0;
 }
 
 static long tof_misc_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
 {
-    struct miscdevice *misc = (struct miscdevice *)f->private_data;
-    struct tof_sensor_chip *chip =
-        container_of(misc, struct tof_sensor_chip, tof_mdev);
+    struct tof_reader *reader = (struct tof_reader *)f->private_data;
+    struct tof_sensor_chip *chip = reader->chip;
     int ret = 0;
     int nr = _IOC_NR(cmd);
+    u32 flags;
 
     if (_IOC_TYPE(cmd) != TMF882X_IOC_MAG) return -ENOTTY;
     if ((nr < TMF882X_IOC_BASE) || (nr >= TMF882X_IOC_MAXNR)) return -ENOTTY;
 
+    // batched reads may block, they only take the reader read_lock
+    if (cmd == TMF882X_IOCREADBATCH)
+        return tof_misc_read_batch(f, (struct tmf882x_read_batch __user *)arg);
+
     if (f->f_flags & O_NONBLOCK) {
         ret = AMS_MUTEX_TRYLOCK(&chip->lock);
         if(!ret){
@@ -2600,13 +4389,56 @@ static long tof_misc_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
 
     switch (cmd) {
         case TMF882X_IOCFIFOFLUSH:
-            kfifo_reset(&chip->fifo_out);
+            spin_lock(&reader->fifo_lock);
+            tof_reader_fifo_reset(reader);
+            spin_unlock(&reader->fifo_lock);
             break;
         case TMF882X_IOCAPPRESET:
             ret = tof_hard_reset(chip);
             if (ret)
                 ret = -EIO;
             break;
+        case TMF882X_IOCSETMSGMASK:
+            ret = get_user(reader->msg_mask, (__u32 __user *)arg);
+            break;
+        case TMF882X_IOCGETMSGMASK:
+            ret = put_user(reader->msg_mask, (__u32 __user *)arg);
+            break;
+        case TMF882X_IOCSETMSGFLAGS:
+            ret = get_user(flags, (__u32 __user *)arg);
+            if (ret)
+                break;
+            if (flags & ~TMF882X_MSG_FLAGS_ALL) {
+                ret = -EINVAL;
+                break;
+            }
+            // applies to messages queued from now on
+            spin_lock(&reader->fifo_lock);
+            reader->msg_flags = flags;
+            spin_unlock(&reader->fifo_lock);
+            break;
+        case TMF882X_IOCGETMSGFLAGS:
+            ret = put_user(reader->msg_flags, (__u32 __user *)arg);
+            break;
+        case TMF882X_IOCGETDROPPED:
+            ret = put_user(reader->dropped, (__u32 __user *)arg);
+            break;
+        case TMF882X_IOCSETWATERMARK:
+            if (copy_from_user(&reader->wm, (void __user *)arg,
+                               sizeof(reader->wm))) {
+                ret = -EFAULT;
+                break;
+            }
+            spin_lock(&reader->fifo_lock);
+            tof_reader_wm_reset(reader);
+            tof_reader_wm_arm(reader);
+            spin_unlock(&reader->fifo_lock);
+            break;
+        case TMF882X_IOCGETWATERMARK:
+            if (copy_to_user((void __user *)arg, &reader->wm,
+                             sizeof(reader->wm)))
+                ret = -EFAULT;
+            break;
         default:
             dev_err(&chip->client->dev, "Error, Unhandled IOCTL cmd\n");
             ret = -ENOTTY;
@@ -2621,6 +4453,7 @@ static const struct file_operations tof_miscdev_fops = {
     .read           = tof_misc_read,
     .poll           = tof_misc_poll,
     .unlocked_ioctl = tof_misc_ioctl,
+    .mmap           = tof_misc_mmap,
     .open           = tof_misc_open,
     .release        = tof_misc_release,
     .llseek         = no_llseek,
@@ -2669,7 +4502,7 @@ static int tmf882x_suspend(struct device *dev)
     }
 
     tmf882x_close(&chip->tof);
-    kfifo_reset(&chip->fifo_out);
+    tof_fifo_flush(chip);
     AMS_MUTEX_UNLOCK(&chip->lock);
     return 0;
 }
@@ -2678,6 +4511,9 @@ static int tmf882x_resume(struct device *dev)
 {
     int error = 0;
     struct tof_sensor_chip *chip = dev_get_drvdata(dev);
+    // the probe time FWDL brings the device up itself
+    if (!completion_done(&chip->fwdl_done))
+        return 0;
     AMS_MUTEX_LOCK(&chip->lock);
     dev_info(&chip->client->dev, "%s\n", __func__);
     error = tof_open_mode(chip, TMF882X_MODE_APP);
@@ -2701,6 +4537,38 @@ static int tmf882x_resume(struct device *dev)
     return 0;
 }
 
+static void tof_destroy_worker(void *worker)
+{
+    kthread_destroy_worker(worker);
+}
+
+/**
+ * tof_decode_worker_create - Start the decode worker thread
+ *
+ * @chip: tof_sensor_chip pointer
+ * @devaddr: I2C address of the device, used in the thread name
+ *
+ * The worker runs at the highest nice level, like the IRQ thread it takes
+ * work from, and is bound to the 'decode_cpu' module parameter if set.
+ */
+static int tof_decode_worker_create(struct tof_sensor_chip *chip, u16 devaddr)
+{
+    struct kthread_worker *worker;
+    int cpu = READ_ONCE(decode_cpu);
+
+    worker = kthread_create_worker(0, "tof_decode_%02x", devaddr);
+    if (IS_ERR(worker))
+        return PTR_ERR(worker);
+    chip->decode_worker = worker;
+    set_user_nice(worker->task, MIN_NICE);
+    if ((cpu >= 0) && (cpu < nr_cpu_ids) && cpu_online(cpu))
+        (void) set_cpus_allowed_ptr(worker->task, cpumask_of(cpu));
+    else if (cpu >= 0)
+        dev_warn(&chip->client->dev, "decode_cpu %d is not online\n", cpu);
+    return devm_add_action_or_reset(&chip->client->dev, tof_destroy_worker,
+                                    worker);
+}
+
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(6,2,0)
 static int tof_probe(struct i2c_client *client)
 #else
@@ -2710,6 +4578,7 @@ static int tof_probe(struct i2c_client *client, const struct i2c_device_id *id)
     struct tof_sensor_chip *tof_chip;
     int error = 0;
     void *poll_prop_ptr = NULL;
+    void *fifo_prop_ptr = NULL;
     int i;
 
     dev_info(&client->dev, "I2C Address: %#04x\n", client->addr);
@@ -2719,8 +4588,21 @@ static int tof_probe(struct i2c_client *client, const struct i2c_device_id *id)
     if (!tof_chip)
         return -ENOMEM;
 
+    // bounce buffer of the I2C write path, allocated once per chip
+    tof_chip->i2c_wbuf = devm_kmalloc(&client->dev, TOF_I2C_WBUF_SIZE, GFP_KERNEL);
+    if (!tof_chip->i2c_wbuf)
+        return -ENOMEM;
+    tof_chip->i2c_nostart = i2c_check_functionality(client->adapter,
+                                                    I2C_FUNC_NOSTART);
+    // single register accesses go through a cache, see tof_regmap_config
+    tof_chip->regmap = devm_regmap_init(&client->dev, NULL, tof_chip,
+                                        &tof_regmap_config);
+    if (IS_ERR(tof_chip->regmap))
+        return PTR_ERR(tof_chip->regmap);
+
     /***** Setup data structures *****/
     mutex_init(&tof_chip->lock);
+    mutex_init(&tof_chip->i2c_wbuf_lock);
     char idevname [30];
     sprintf(idevname, "%s_%02X", TMF882X_NAME, devaddr_buf);
     tof_pdata.tof_name = idevname;
@@ -2729,10 +4611,18 @@ static int tof_probe(struct i2c_client *client, const struct i2c_device_id *id)
     tof_chip->pdata = &tof_pdata;
     i2c_set_clientdata(client, tof_chip);
     /***** Firmware sync structure initialization*****/
-    init_completion(&tof_chip->ram_patch_in_progress);
-    //initialize kfifo for frame output
-    INIT_KFIFO(tof_chip->fifo_out);
+    init_completion(&tof_chip->fwdl_done);
+    INIT_WORK(&tof_chip->fwdl_work, tof_fwdl_work);
+    init_completion(&tof_chip->cmd_done);
+    init_completion(&tof_chip->decode_done);
+    kthread_init_work(&tof_chip->decode_work, tof_decode_work);
+    error = tof_decode_worker_create(tof_chip, devaddr_buf);
+    if (error)
+        return error;
+    // every open file of the char device gets its own output kfifo
+    INIT_LIST_HEAD(&tof_chip->readers);
     init_waitqueue_head(&tof_chip->fifo_wait);
+    spin_lock_init(&tof_chip->ring_lock);
     // init core ToF DCB
     tmf882x_init(&tof_chip->tof, tof_chip);
 
@@ -2775,6 +4665,24 @@ static int tof_probe(struct i2c_client *client, const struct i2c_device_id *id)
                                             TOF_PROP_NAME_POLLIO,
                                             NULL);
     tof_chip->poll_period = poll_prop_ptr ? be32_to_cpup(poll_prop_ptr) : 0;
+
+    fifo_prop_ptr = (void *)of_get_property(tof_chip->client->dev.of_node,
+                                            TOF_PROP_NAME_FIFO_SIZE,
+                                            NULL);
+    if (fifo_size)
+        tof_chip->fifo_size[TOF_LANE_BULK] = tof_fifo_size_clamp(fifo_size);
+    else if (fifo_prop_ptr)
+        tof_chip->fifo_size[TOF_LANE_BULK] =
+            tof_fifo_size_clamp(be32_to_cpup(fifo_prop_ptr));
+    else
+        tof_chip->fifo_size[TOF_LANE_BULK] = TOF_FIFO_SIZE;
+    tof_chip->fifo_size[TOF_LANE_RESULT] = TOF_FIFO_SIZE;
+    tof_chip->hist_decimation = TOF_HIST_DECIMATION_DEF;
+    tof_chip->hist_high_water = TOF_HIST_HIGH_WATER_DEF;
+    tof_chip->hist_low_water = TOF_HIST_LOW_WATER_DEF;
+    dev_info(&client->dev, "Output FIFO size: %u bytes (result), %u bytes (bulk)\n",
+             tof_chip->fifo_size[TOF_LANE_RESULT],
+             tof_chip->fifo_size[TOF_LANE_BULK]);
     if (tof_chip->poll_period == 0) {
         /*** Use Interrupt I/O instead of polled ***/
         /***** Setup GPIO IRQ handler *****/
@@ -2800,16 +4708,17 @@ static int tof_probe(struct i2c_client *client, const struct i2c_device_id *id)
         }
     }
 
-    error = tof_hard_reset(tof_chip);
-    if (error) {
-        dev_err(&client->dev, "Chip init failed.\n");
-        AMS_MUTEX_UNLOCK(&tof_chip->lock);
-        goto gen_err;
-    }
-
     // Change I2C address only if it is different from default    
     if(devaddr_buf != TMF_DEFAULT_I2C_ADDR)
     {
+        // the address change needs the app, so bring it up synchronously
+        error = tof_hard_reset(tof_chip);
+        if (error) {
+            dev_err(&client->dev, "Chip init failed.\n");
+            AMS_MUTEX_UNLOCK(&tof_chip->lock);
+            goto gen_err;
+        }
+
         dev_info(&client->dev, "Changing I2C Address: %#04x -> %#04x\n", TMF_DEFAULT_I2C_ADDR, devaddr_buf);
         uint8_t buf[2];
     
@@ -2894,6 +4803,15 @@ static int tof_probe(struct i2c_client *client, const struct i2c_device_id *id)
     // Turn off device until requested
     // tof_poweroff_device(tof_chip);
 
+    if (devaddr_buf == TMF_DEFAULT_I2C_ADDR) {
+        // FWDL and app bring-up continue in the background, see fw_ready
+        tof_chip->fwdl_busy = true;
+        AMS_MUTEX_UNLOCK(&tof_chip->lock);
+        queue_work(system_unbound_wq, &tof_chip->fwdl_work);
+        dev_info(&client->dev, "Probe ok, FWDL in progress.\n");
+        return 0;
+    }
+
     // stop measurements
     if (tmf882x_stop(&tof_chip->tof)) {
         dev_info(&client->dev, "Error stopping measurements\n");
@@ -2901,7 +4819,8 @@ static int tof_probe(struct i2c_client *client, const struct i2c_device_id *id)
         goto gen_err;
     }
     // stopping measurements, lets flush the ring buffer
-    kfifo_reset(&tof_chip->fifo_out);
+    tof_fifo_flush(tof_chip);
+    complete_all(&tof_chip->fwdl_done);
 
     AMS_MUTEX_UNLOCK(&tof_chip->lock);
     dev_info(&client->dev, "Probe ok.\n");
@@ -2938,6 +4857,9 @@ static int tof_remove(struct i2c_client *client)
 {
     struct tof_sensor_chip *chip = i2c_get_clientdata(client);
 
+    // a probe time FWDL must not race with the teardown
+    cancel_work_sync(&chip->fwdl_work);
+    complete_all(&chip->fwdl_done);
     (void) tof_poweroff_device(chip);
     chip->driver_remove = true;
     wake_up_all(&chip->fifo_wait);
@@ -2960,10 +4882,14 @@ static int tof_remove(struct i2c_client *client)
         devm_free_irq(&client->dev, client->irq, chip);
     }
 
+    // no more IRQs can queue the decode worker at this point
+    kthread_cancel_work_sync(&chip->decode_work);
+
     misc_deregister(&chip->tof_mdev);
     input_unregister_device(chip->tof_idev);
     sysfs_remove_groups(&client->dev.kobj,
                         (const struct attribute_group **)&tof_groups);
+    tof_fw_cache_drop(chip);
 
     i2c_set_clientdata(client, NULL);
     dev_info(&client->dev, "%s\n", __func__);
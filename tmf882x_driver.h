@@ -47,6 +47,21 @@ struct tof_sensor_chip;
 extern struct device * tof_to_dev(struct tof_sensor_chip *chip);
 extern int tof_frwk_i2c_read(struct tof_sensor_chip *chip, char reg, char *buf, int len);
 extern int tof_frwk_i2c_write(struct tof_sensor_chip *chip, char reg, const char *buf, int len);
+extern int tof_frwk_reg_read(struct tof_sensor_chip *chip, u8 reg, u8 *val);
+extern int tof_frwk_reg_write(struct tof_sensor_chip *chip, u8 reg, u8 val);
+extern void tof_frwk_regcache_drop(struct tof_sensor_chip *chip);
 extern int tof_frwk_queue_msg(struct tof_sensor_chip *chip, struct tmf882x_msg *msg);
+extern bool tof_frwk_irq_is_polled(struct tof_sensor_chip *chip);
+extern int tof_frwk_cmd_irq_arm(struct tof_sensor_chip *chip);
+extern bool tof_frwk_irq_thread_pending(struct tof_sensor_chip *chip);
+extern int tof_frwk_cmd_irq_wait(struct tof_sensor_chip *chip, u32 timeout_us);
+extern void tof_frwk_cmd_irq_disarm(struct tof_sensor_chip *chip);
+extern u64 tof_frwk_irq_timestamp(struct tof_sensor_chip *chip);
+extern int tof_frwk_queue_msg_at(struct tof_sensor_chip *chip, struct tmf882x_msg *msg,
+                                 u64 timestamp_ns);
+extern int tof_frwk_schedule_decode(struct tof_sensor_chip *chip);
+extern void tof_frwk_decode_sync(struct tof_sensor_chip *chip);
+extern void tof_frwk_result_irq(struct tof_sensor_chip *chip);
+extern void tof_frwk_poll_reset(struct tof_sensor_chip *chip, bool stats);
 
 #endif /* __TMF882X_DRIVER_H */
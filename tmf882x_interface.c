@@ -171,6 +171,24 @@ inline int32_t tmf882x_process_irq(struct tmf882x_tof * tof)
     return -1;
 }
 
+inline int32_t tmf882x_decode(struct tmf882x_tof * tof)
+{
+    if (tof && tof->state.ops->decode) {
+        return tof->state.ops->decode(&tof->state);
+    }
+
+    return 0;
+}
+
+inline int32_t tmf882x_publish(struct tmf882x_tof * tof)
+{
+    if (tof && tof->state.ops->publish) {
+        return tof->state.ops->publish(&tof->state);
+    }
+
+    return 0;
+}
+
 inline int32_t tmf882x_start(struct tmf882x_tof * tof)
 {
     if (tof && tof->state.ops->start) {
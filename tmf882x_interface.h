@@ -77,6 +77,7 @@ typedef enum tmf882x_mode_t {
 typedef enum tmf882x_fwdl_type_t {
     FWDL_TYPE_BIN,
     FWDL_TYPE_HEX,
+    FWDL_TYPE_SEG, /**< pre-converted image, see @ref tmf882x_fw_seg */
 } tmf882x_fwdl_type_t;
 
 /**
@@ -198,6 +199,32 @@ extern int32_t tmf882x_start(struct tmf882x_tof * tof);
  */
 extern int32_t tmf882x_process_irq(struct tmf882x_tof * tof);
 
+/**
+ * @brief
+ *      Decode the oldest data message that @ref tmf882x_process_irq deferred
+ *      to the platform decode worker (see tof_schedule_decode). Performs no
+ *      I/O with the device and may run concurrently with
+ *      @ref tmf882x_process_irq
+ * @param[in] tof
+ *      tof dcb interface context
+ * @return 1 if a message was decoded and waits for @ref tmf882x_publish,
+ *      0 if there was nothing to decode
+ */
+extern int32_t tmf882x_decode(struct tmf882x_tof * tof);
+
+/**
+ * @brief
+ *      Publish the data message decoded by @ref tmf882x_decode, if any, and
+ *      claim the next deferred message for the following @ref tmf882x_decode
+ *      call. Any output data is passed through shim platform layer in the form
+ *      of one or more @ref tmf882x_msg. Must be serialized with
+ *      @ref tmf882x_process_irq
+ * @param[in] tof
+ *      tof dcb interface context
+ * @return 0 for sucess, otherwise failure
+ */
+extern int32_t tmf882x_publish(struct tmf882x_tof * tof);
+
 /**
  * @brief
  *      Stop measurements
@@ -120,6 +120,10 @@ struct tmf882x_mode;
  *      This member is the stop method call for the current mode
  * @var mode_vtable::process_irq
  *      This member is the process_irq method call for the current mode
+ * @var mode_vtable::decode
+ *      This member is the decode method call for the current mode
+ * @var mode_vtable::publish
+ *      This member is the publish method call for the current mode
  * @var mode_vtable::close
  *      This member is the close method call for the current mode
  * @warning
@@ -144,6 +148,10 @@ struct mode_vtable {
 
     int32_t (*process_irq) (struct tmf882x_mode *self);
 
+    int32_t (*decode) (struct tmf882x_mode *self);
+
+    int32_t (*publish) (struct tmf882x_mode *self);
+
     int32_t (*ioctl) (struct tmf882x_mode *self, uint32_t cmd,
                       const void *input, void *output);
 
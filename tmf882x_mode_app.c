@@ -38,14 +38,34 @@
 #define NUM_8x8_CFG (4)
 #define CLK_CORR_ENABLE                 1
 #define CONFIG_BATCH_THRESH             10
+// common config registers encoded by encode_config_msg()
+#define CONFIG_FIRST_REG                TMF8X2X_COM_PERIOD_MS_LSB
+#define CONFIG_NUM_REGS                 (TMF8X2X_COM_OSC_TRIM_VALUE_LSB + 2 - \
+                                         CONFIG_FIRST_REG)
+// max clean registers re-written to merge two dirty config blocks
+#define CONFIG_WRITE_GAP                3
 // ratio of host clk (1 MHz) to tof clk (5 MHz) is 5
 #define TMF882X_SYSTICK_RATIO           5
 #define TID_CHANGE_RETRIES              3
+// recv result while a multi-packet message waits for its next sub-packet
+#define APP_RECV_PENDING                1
+// recv result when a sub-packet was lost and a new message has to be parsed
+#define APP_RECV_RESYNC                 2
+// bound on messages abandoned in a row for lost sub-packets
+#define APP_RECV_MAX_RESYNC             4
+#define APP_PACKET_POLL_US              100
+#define MS_TIME_TO_POLLS(ms)            ((ms)*1000/(APP_PACKET_POLL_US))
 #define CMD_DEF_TIMEOUT_MS              30
 #define CMD_FAC_CALIB_TIMEOUT_MS        6000
 #define CMD_USLEEP_INCR                 10
 #define CMD_TIMEOUT_RETRIES             ((CMD_DEF_TIMEOUT_MS*1000)/(CMD_USLEEP_INCR))
-#define MS_TIME_TO_RETRIES(ms)          ((ms)*1000/(CMD_USLEEP_INCR))
+// smallest read that decodes a header including the sub-packet header
+#define APP_RECV_MIN_SIZE               (TMF8X2X_COM_HEADER_SIZE + \
+                                         TMF8X2X_COM_OPTIONAL_SUBPACKET_HEADER_SIZE)
+// bound on a missed CMD_DONE IRQ
+#define CMD_IRQ_SLICE_US                1000
+// CMD_STAT polls before sleeping on CMD_DONE, short commands are done by then
+#define CMD_SPIN_RETRIES                20
 #define BITS_IN_BYTE                    8
 #define TMF882X_INT_MASK                0x7
 #define RESULT_IDX_TO_CHANNEL(idx)     (((idx)%((TMF882X_HIST_NUM_TDC*2)-1)) + 1)
@@ -496,17 +516,41 @@ static int32_t check_cmd_status(struct tmf882x_mode_app *app,
     return check_app_cmd_status(app, status);
 }
 
-static int32_t check_cmd_status_timeout(struct tmf882x_mode_app *app,
-                                    uint32_t timeout_ms)
+static int32_t wait_cmd_done(struct tmf882x_mode_app *app,
+                             uint32_t timeout_ms)
 {
-    uint32_t wait_ms = 0;
+    // sleeps may be rounded up (to a jiffy for the IRQ wait), so the time
+    // actually spent is measured instead of counting the waits
+    uint64_t deadline = tof_get_time_us() + (uint64_t)timeout_ms * 1000;
+    uint64_t now;
+    int32_t spins = CMD_SPIN_RETRIES;
+    uint8_t status;
 
-    // Wait part of the timeout before checking cmd status
-    if (timeout_ms) {
-        wait_ms = timeout_ms >> 3; // initial wait fraction 1/8
-        tof_usleep(priv(app), wait_ms * 1000);
+    status = get_app_cmd_stat(app);
+    while (APP_IS_CMD_BUSY(status) && ((now = tof_get_time_us()) < deadline)) {
+        // poll briefly first, then sleep on CMD_DONE unless a pending IRQ
+        // thread keeps the oneshot line masked
+        if ((spins > 0) || !app->volat_data.cmd_irq_armed ||
+            tof_irq_thread_pending(priv(app))) {
+            tof_usleep(priv(app), CMD_USLEEP_INCR);
+            spins -= 1;
+        } else {
+            (void) tof_cmd_irq_wait(priv(app),
+                                    ams_min(CMD_IRQ_SLICE_US, deadline - now));
+        }
+        status = get_app_cmd_stat(app);
+    }
+
+    if (app->volat_data.cmd_irq_armed) {
+        tof_cmd_irq_disarm(priv(app));
+        app->volat_data.cmd_irq_armed = false;
+
+        // ack CMD_DONE only, other IRQs are left pending for the IRQ handler
+        if (tof_set_register(priv(app), TMF882X_INT_STAT, F_CMD_DONE_IRQ)) {
+            tof_err(priv(app), "Error writing INTSTAT");
+        }
     }
-    return check_cmd_status(app, MS_TIME_TO_RETRIES(timeout_ms - wait_ms));
+    return check_app_cmd_status(app, status);
 }
 
 static inline uint32_t timespec_to_usec(struct timespec64 ts)
@@ -549,10 +593,17 @@ static int32_t tmf882x_mode_app_i2c_msg_push(struct tmf882x_mode_app *app,
     tof_app_dbg(app, "app: i2c_msg_send - CMD: %#x SIZE: %u B",
                 i2c_msg->cmd, i2c_msg->size);
 
+    // arm the CMD_DONE completion before the device can raise it
+    app->volat_data.cmd_irq_armed = app->volat_data.cmd_irq_enabled &&
+                                    !tof_cmd_irq_arm(priv(app));
+
     /* commit command */
     rc = tof_set_register(priv(app), TMF8X2X_COM_CMD_STAT,
                           i2c_msg->cmd);
     if (rc) {
+        if (app->volat_data.cmd_irq_armed)
+            tof_cmd_irq_disarm(priv(app));
+        app->volat_data.cmd_irq_armed = false;
         tof_err(priv(app), "Error: %d writing App i2c_msg command", rc);
         TOF_SET_ERR_MSG(to_msg(app), ERR_COMM);
         tof_queue_msg(priv(app), to_msg(app));
@@ -576,8 +627,11 @@ static void tmf882x_force_stop(struct tmf882x_mode_app *app)
     (void) tmf882x_mode_standby_operation(to_parent(app), TOF_WAKEUP);
     (void) tmf882x_mode_app_i2c_msg_push(app, i2c_msg);
     // try to wait for STOP command completed
-    (void) check_cmd_status(app, CMD_TIMEOUT_RETRIES);
+    (void) wait_cmd_done(app, CMD_DEF_TIMEOUT_MS);
+    tof_poll_reset(priv(app), false);
     app->volat_data.is_measuring = false;
+    app->volat_data.mp_pending = false;
+    app->volat_data.pipe_gen++;
 }
 
 static int32_t tmf882x_mode_app_i2c_msg_send(struct tmf882x_mode_app *app,
@@ -596,7 +650,7 @@ static int32_t tmf882x_mode_app_i2c_msg_send(struct tmf882x_mode_app *app,
     }
 
     // check that command status is successful
-    rc = check_cmd_status(app, CMD_TIMEOUT_RETRIES);
+    rc = wait_cmd_done(app, CMD_DEF_TIMEOUT_MS);
     if (rc) {
         tof_err(priv(app), "Error (%d) timeout waiting for msg send complete",
                 rc);
@@ -628,7 +682,11 @@ static int32_t tmf882x_mode_app_stop_measurements(struct tmf882x_mode *self)
         tof_err(priv(app), "Error (%d) stopping measurements", rc);
     }
 
+    // the frame period may change before the next capture
+    tof_poll_reset(priv(app), false);
     app->volat_data.is_measuring = false;
+    app->volat_data.mp_pending = false;
+    app->volat_data.pipe_gen++;
     return rc;
 }
 
@@ -655,6 +713,7 @@ static int32_t tmf882x_mode_app_start_measurements(struct tmf882x_mode *self)
     //restart our capture iteration counter
     app->volat_data.capture_num = 1;
     tmf882x_clk_corr_recalc(&app->volat_data.clk_cr);
+    tof_poll_reset(priv(app), true);
     app->volat_data.is_measuring = true;
     return rc;
 }
@@ -718,15 +777,15 @@ static int32_t app_trim_osc(struct tmf882x_mode_app *app, int32_t steps)
 #endif
 
 static int32_t clock_skew_correction(struct tmf882x_mode_app *app,
-                                     struct tmf882x_msg_meas_results *results)
+                                     struct tmf882x_msg_meas_results *results,
+                                     const struct timespec64 *irq_ts)
 {
     // Assume timespec is defined by platform include files
-    struct timespec64 current_ts = {0};
+    struct timespec64 current_ts = *irq_ts;
     uint32_t usec_epoch = 0;
     uint32_t cr_dist = 0;
     uint32_t i = 0;
 
-    tof_get_timespec(&current_ts);
     if ( (current_ts.tv_sec - app->volat_data.timestamp.tv_sec) >= 60 ) {
         // Reset our clock correction averaging every minute so we can still
         //  be responsive to clock drift in the device
@@ -794,21 +853,12 @@ static int32_t clock_skew_correction(struct tmf882x_mode_app *app,
     return 0;
 }
 
-static int32_t publish_measure_results(struct tmf882x_mode_app *app,
-                                       struct tmf882x_msg_meas_results *results)
-{
-    // perform clock correction on results before publishing
-    (void) clock_skew_correction(app, results);
-
-    // fire away
-    return tof_queue_msg(priv(app), to_msg(app));
-}
-
 static int32_t decode_result_msg(struct tmf882x_mode_app *app,
-                                 const struct tmf882x_mode_app_i2c_msg *i2c_msg)
+                                 const struct tmf882x_mode_app_i2c_msg *i2c_msg,
+                                 struct tmf882x_msg *msg)
 {
     uint32_t i = 0, j = 0;
-    struct tmf882x_msg_meas_results *result_msg = &(to_msg(app)->meas_result_msg);
+    struct tmf882x_msg_meas_results *result_msg = &msg->meas_result_msg;
     const uint8_t *head = i2c_msg->buf;
     const uint8_t *tail = NULL;
     uint8_t confidence = 0;
@@ -874,19 +924,15 @@ static int32_t decode_result_msg(struct tmf882x_mode_app *app,
         tmf882x_dump_data(to_parent(app), tail, extra_data);
     }
 
-    // Try to keep up with which measurement iteration we are on, 256 rollover
-    app->volat_data.capture_num = result_msg->result_num + 1;
-    if (app->volat_data.capture_num == 256)
-        app->volat_data.capture_num = 0;
-
-    return publish_measure_results(app, result_msg);
+    return 0;
 }
 
 static int32_t decode_meas_stats_msg(struct tmf882x_mode_app *app,
-                                 const struct tmf882x_mode_app_i2c_msg *i2c_msg)
+                                 const struct tmf882x_mode_app_i2c_msg *i2c_msg,
+                                 struct tmf882x_msg *msg)
 {
     uint32_t i;
-    struct tmf882x_msg_meas_stats *stat_msg = &(to_msg(app)->meas_stat_msg);
+    struct tmf882x_msg_meas_stats *stat_msg = &msg->meas_stat_msg;
     const uint8_t *head = i2c_msg->buf;
     const uint8_t *tail;
 
@@ -894,9 +940,6 @@ static int32_t decode_meas_stats_msg(struct tmf882x_mode_app *app,
     TOF_ZERO_MSG(stat_msg);
     TOF_SET_MSG_HDR(stat_msg, ID_MEAS_STATS, struct tmf882x_msg_meas_stats);
 
-    // This tag *should* match the 'result_num' from the next measurement
-    // result data
-    stat_msg->capture_num = app->volat_data.capture_num;
     //fill out sub-capture index field
     decode_8b(&head[reg_to_idx(TMF8X2X_COM_STATISTICS_CFG_IDX)],
               (uint8_t *)&stat_msg->sub_capture);
@@ -920,8 +963,43 @@ static int32_t decode_meas_stats_msg(struct tmf882x_mode_app *app,
         tail = decode_32b(tail, &stat_msg->saturation_cnt[i]);
     }
 
-    // publish statistic data
-    return tof_queue_msg(priv(app), to_msg(app));
+    return 0;
+}
+
+static void mark_config_dirty(uint8_t *dirty, uint32_t reg, uint32_t len)
+{
+    for (; len; --len, ++reg)
+        dirty[reg - CONFIG_FIRST_REG] = 1;
+}
+
+static int32_t write_dirty_config(struct tmf882x_mode_app *app,
+                                  const uint8_t *head, const uint8_t *dirty)
+{
+    uint32_t i = 0;
+    uint32_t first, last;
+
+    while (i < CONFIG_NUM_REGS) {
+        if (!dirty[i]) {
+            ++i;
+            continue;
+        }
+        // extend the block over clean registers up to the gap threshold,
+        //  every register in the range holds the encoded current value
+        for (first = last = i++; i < CONFIG_NUM_REGS; ++i) {
+            if (dirty[i])
+                last = i;
+            else if (i - last > CONFIG_WRITE_GAP)
+                break;
+        }
+        tof_app_dbg(app, "config block write reg: %#x len: %u",
+                    CONFIG_FIRST_REG + first, last - first + 1);
+        if (tof_i2c_write(priv(app), CONFIG_FIRST_REG + first,
+                          &head[reg_to_idx(CONFIG_FIRST_REG + first)],
+                          last - first + 1))
+            return -1;
+        i = last + 1;
+    }
+    return 0;
 }
 
 static int32_t update_each_config_setting(struct tmf882x_mode_app *app,
@@ -929,73 +1007,44 @@ static int32_t update_each_config_setting(struct tmf882x_mode_app *app,
                                           const struct tmf882x_mode_app_config *cfg)
 {
     uint8_t *head = i2c_msg->buf;
+    uint8_t dirty[CONFIG_NUM_REGS] = {0};
 
     if (cfg->report_period_ms != app->volat_data.cfg.report_period_ms)
-        if (tof_i2c_write(priv(app), TMF8X2X_COM_PERIOD_MS_LSB,
-                          &head[reg_to_idx(TMF8X2X_COM_PERIOD_MS_LSB)], 2))
-            return -1;
+        mark_config_dirty(dirty, TMF8X2X_COM_PERIOD_MS_LSB, 2);
     if (cfg->kilo_iterations != app->volat_data.cfg.kilo_iterations)
-        if (tof_i2c_write(priv(app), TMF8X2X_COM_KILO_ITERATIONS_LSB,
-                          &head[reg_to_idx(TMF8X2X_COM_KILO_ITERATIONS_LSB)], 2))
-            return -1;
+        mark_config_dirty(dirty, TMF8X2X_COM_KILO_ITERATIONS_LSB, 2);
     if (cfg->low_threshold != app->volat_data.cfg.low_threshold)
-        if (tof_i2c_write(priv(app), TMF8X2X_COM_INT_THRESHOLD_LOW_LSB,
-                          &head[reg_to_idx(TMF8X2X_COM_INT_THRESHOLD_LOW_LSB)], 2))
-            return -1;
+        mark_config_dirty(dirty, TMF8X2X_COM_INT_THRESHOLD_LOW_LSB, 2);
     if (cfg->high_threshold != app->volat_data.cfg.high_threshold)
-        if (tof_i2c_write(priv(app), TMF8X2X_COM_INT_THRESHOLD_HIGH_LSB,
-                          &head[reg_to_idx(TMF8X2X_COM_INT_THRESHOLD_HIGH_LSB)], 2))
-            return -1;
+        mark_config_dirty(dirty, TMF8X2X_COM_INT_THRESHOLD_HIGH_LSB, 2);
     if (cfg->zone_mask != app->volat_data.cfg.zone_mask)
-        if (tof_i2c_write(priv(app), TMF8X2X_COM_INT_ZONE_MASK_0,
-                          &head[reg_to_idx(TMF8X2X_COM_INT_ZONE_MASK_0)], 3))
-            return -1;
+        mark_config_dirty(dirty, TMF8X2X_COM_INT_ZONE_MASK_0, 3);
     if (cfg->persistence != app->volat_data.cfg.persistence)
-        if (tof_i2c_write(priv(app), TMF8X2X_COM_INT_PERSISTENCE,
-                          &head[reg_to_idx(TMF8X2X_COM_INT_PERSISTENCE)], 1))
-            return -1;
+        mark_config_dirty(dirty, TMF8X2X_COM_INT_PERSISTENCE, 1);
     if (cfg->confidence_threshold != app->volat_data.cfg.confidence_threshold)
-        if (tof_i2c_write(priv(app), TMF8X2X_COM_CONFIDENCE_THRESHOLD,
-                          &head[reg_to_idx(TMF8X2X_COM_CONFIDENCE_THRESHOLD)], 1))
-            return -1;
+        mark_config_dirty(dirty, TMF8X2X_COM_CONFIDENCE_THRESHOLD, 1);
     if (cfg->gpio_0 != app->volat_data.cfg.gpio_0)
-        if (tof_i2c_write(priv(app), TMF8X2X_COM_GPIO_0,
-                          &head[reg_to_idx(TMF8X2X_COM_GPIO_0)], 1))
-            return -1;
+        mark_config_dirty(dirty, TMF8X2X_COM_GPIO_0, 1);
     if (cfg->gpio_1 != app->volat_data.cfg.gpio_1)
-        if (tof_i2c_write(priv(app), TMF8X2X_COM_GPIO_1,
-                          &head[reg_to_idx(TMF8X2X_COM_GPIO_1)], 1))
-            return -1;
+        mark_config_dirty(dirty, TMF8X2X_COM_GPIO_1, 1);
     if (cfg->power_cfg != app->volat_data.cfg.power_cfg)
-        if (tof_i2c_write(priv(app), TMF8X2X_COM_POWER_CFG,
-                          &head[reg_to_idx(TMF8X2X_COM_POWER_CFG)], 1))
-            return -1;
+        mark_config_dirty(dirty, TMF8X2X_COM_POWER_CFG, 1);
     if (cfg->spad_map_id != app->volat_data.cfg.spad_map_id)
-        if (tof_i2c_write(priv(app), TMF8X2X_COM_SPAD_MAP_ID,
-                          &head[reg_to_idx(TMF8X2X_COM_SPAD_MAP_ID)], 1))
-            return -1;
+        mark_config_dirty(dirty, TMF8X2X_COM_SPAD_MAP_ID, 1);
     if (cfg->alg_setting != app->volat_data.cfg.alg_setting)
-        if (tof_i2c_write(priv(app), TMF8X2X_COM_ALG_SETTING_0,
-                          &head[reg_to_idx(TMF8X2X_COM_ALG_SETTING_0)], 4))
-            return -1;
+        mark_config_dirty(dirty, TMF8X2X_COM_ALG_SETTING_0, 4);
     if (cfg->histogram_dump != app->volat_data.cfg.histogram_dump)
-        if (tof_i2c_write(priv(app), TMF8X2X_COM_HIST_DUMP,
-                          &head[reg_to_idx(TMF8X2X_COM_HIST_DUMP)], 1))
-            return -1;
+        mark_config_dirty(dirty, TMF8X2X_COM_HIST_DUMP, 1);
     if (cfg->spread_spectrum != app->volat_data.cfg.spread_spectrum)
-        if (tof_i2c_write(priv(app), TMF8X2X_COM_SPREAD_SPECTRUM,
-                          &head[reg_to_idx(TMF8X2X_COM_SPREAD_SPECTRUM)], 1))
-            return -1;
+        mark_config_dirty(dirty, TMF8X2X_COM_SPREAD_SPECTRUM, 1);
     if (cfg->i2c_slave_addr != app->volat_data.cfg.i2c_slave_addr)
-        if (tof_i2c_write(priv(app), TMF8X2X_COM_I2C_SLAVE_ADDRESS,
-                          &head[reg_to_idx(TMF8X2X_COM_I2C_SLAVE_ADDRESS)], 1))
-            return -1;
+        mark_config_dirty(dirty, TMF8X2X_COM_I2C_SLAVE_ADDRESS, 1);
     // if OSC trim is enabled, write osc trim value
     if (cfg->power_cfg & TMF8X2X_COM_POWER_CFG__allow_osc_retrim)
-        if (tof_i2c_write(priv(app), TMF8X2X_COM_OSC_TRIM_VALUE_LSB,
-                          &head[reg_to_idx(TMF8X2X_COM_OSC_TRIM_VALUE_LSB)], 2))
-            return -1;
-    return 0;
+        mark_config_dirty(dirty, TMF8X2X_COM_OSC_TRIM_VALUE_LSB, 2);
+
+    // write the dirty registers in as few block writes as possible
+    return write_dirty_config(app, head, dirty);
 }
 
 static int32_t encode_config_msg(struct tmf882x_mode_app *app,
@@ -1084,9 +1133,9 @@ static int32_t rid_to_histogram_type(struct tmf882x_mode_app *app,
 }
 
 static int32_t decode_histogram_msg(struct tmf882x_mode_app *app,
-                                    const struct tmf882x_mode_app_i2c_msg *i2c_msg)
+                                    const struct tmf882x_mode_app_i2c_msg *i2c_msg,
+                                    struct tmf882x_msg *msg)
 {
-    struct tmf882x_msg *msg = to_msg(app);
     uint32_t tdc_idx = 0;
     uint32_t bin_idx = 0;
     uint32_t byte_idx = 0;
@@ -1144,9 +1193,6 @@ static int32_t decode_histogram_msg(struct tmf882x_mode_app *app,
     TOF_SET_HISTOGRAM_MSG(msg, hist_type);
     msg->hist_msg.num_bins = num_bins;
     msg->hist_msg.num_tdc = num_tdc;
-    // This tag *should* match the 'result_num' from the next measurement
-    // result data
-    msg->hist_msg.capture_num = app->volat_data.capture_num;
 
     for (tdc_idx = 0; tdc_idx < num_tdc; ++tdc_idx) {
 
@@ -1164,11 +1210,173 @@ static int32_t decode_histogram_msg(struct tmf882x_mode_app *app,
     // Update time-multiplexed index (sub capture)
     msg->hist_msg.sub_capture = i2c_msg->cfg_id;
 
-    // publish histogram data
-    return tof_queue_msg(priv(app), msg);
+    return 0;
 }
 #endif
 
+/* Decode a data message, no device I/O and no shared app state is touched */
+static int32_t decode_data_msg(struct tmf882x_mode_app *app,
+                               const struct tmf882x_mode_app_i2c_msg *i2c_msg,
+                               struct tmf882x_msg *msg)
+{
+    switch(i2c_msg->rid) {
+        case TMF8X2X_COM_CONFIG_RESULT__cid_rid__MEASUREMENT_RESULT:
+            return decode_result_msg(app, i2c_msg, msg);
+#if (CONFIG_TMF882X_HISTOGRAM_SUPPORT())
+        case TMF8X2X_COM_RID_RAW_HISTOGRAM_24_BITS:
+        case TMF8X2X_COM_RID_ELECTRICAL_CALIBRATION_24_BITS:
+            return decode_histogram_msg(app, i2c_msg, msg);
+#endif
+        case TMF8X2X_COM_CONFIG_RESULT__cid_rid__ACCUMULATED_HITS_RESULT:
+            return decode_meas_stats_msg(app, i2c_msg, msg);
+        default:
+            return -1;
+    }
+}
+
+/* Tag and publish a decoded data message in the order it was received */
+static int32_t publish_data_msg(struct tmf882x_mode_app *app,
+                                struct tmf882x_msg *msg,
+                                const struct timespec64 *irq_ts,
+                                uint64_t timestamp_ns)
+{
+    switch(msg->hdr.msg_id) {
+        case ID_MEAS_RESULTS:
+            // Try to keep up with which measurement iteration we are on,
+            // 256 rollover
+            app->volat_data.capture_num = msg->meas_result_msg.result_num + 1;
+            if (app->volat_data.capture_num == 256)
+                app->volat_data.capture_num = 0;
+            // perform clock correction on results before publishing
+            (void) clock_skew_correction(app, &msg->meas_result_msg, irq_ts);
+            break;
+        case ID_MEAS_STATS:
+            // This tag *should* match the 'result_num' from the next
+            // measurement result data
+            msg->meas_stat_msg.capture_num = app->volat_data.capture_num;
+            break;
+        case ID_HISTOGRAM:
+            msg->hist_msg.capture_num = app->volat_data.capture_num;
+            break;
+        default:
+            break;
+    }
+
+    // fire away
+    return tof_queue_msg_at(priv(app), msg, timestamp_ns);
+}
+
+static int32_t tmf882x_mode_app_decode(struct tmf882x_mode *self);
+static int32_t tmf882x_mode_app_publish(struct tmf882x_mode *self);
+
+static bool app_pipe_full(struct tmf882x_mode_app *app)
+{
+    return (app->volat_data.pipe_head - app->volat_data.pipe_tail) >=
+           APP_PIPE_DEPTH;
+}
+
+static int32_t app_pipe_make_room(struct tmf882x_mode_app *app)
+{
+    int32_t rc;
+
+    // the worker can not claim another frame while the platform lock is held
+    tof_decode_sync(priv(app));
+    // publish the frame the worker decoded, this claims the next one
+    rc = tmf882x_mode_app_publish(&app->mode);
+    if (app_pipe_full(app)) {
+        // worker did not get to the claimed frame yet, finish it in place
+        (void) tmf882x_mode_app_decode(&app->mode);
+        rc = tmf882x_mode_app_publish(&app->mode);
+    }
+    return rc;
+}
+
+static int32_t app_pipe_push(struct tmf882x_mode_app *app,
+                             const struct tmf882x_mode_app_i2c_msg *i2c_msg)
+{
+    struct tmf882x_mode_app_pipe_slot *slot;
+    int32_t rc;
+
+    if (app_pipe_full(app)) {
+        // decode worker is behind, never drop data to keep up
+        tof_app_dbg(app, "decode pipeline full, RID: %#x", i2c_msg->rid);
+        (void) app_pipe_make_room(app);
+    }
+
+    // copy header fields and only the valid part of the payload
+    slot = &app->volat_data.pipe[app->volat_data.pipe_head % APP_PIPE_DEPTH];
+    memcpy(&slot->i2c_msg, i2c_msg,
+           offsetof(struct tmf882x_mode_app_i2c_msg, buf));
+    memcpy(slot->i2c_msg.buf, i2c_msg->buf, i2c_msg->size);
+    tof_get_timespec(&slot->ts);
+    slot->timestamp_ns = tof_get_irq_timestamp(priv(app));
+    slot->gen = app->volat_data.pipe_gen;
+    app->volat_data.pipe_head++;
+
+    if (tof_schedule_decode(priv(app)) == 0 || app->volat_data.pipe_claimed)
+        return 0;
+
+    // no decode worker available, decode and publish in place
+    app->volat_data.pipe_tail++;
+    rc = decode_data_msg(app, &slot->i2c_msg, to_msg(app));
+    if (rc)
+        return rc;
+    return publish_data_msg(app, to_msg(app), &slot->ts, slot->timestamp_ns);
+}
+
+static int32_t tmf882x_mode_app_decode(struct tmf882x_mode *self)
+{
+    struct tmf882x_mode_app_pipe_slot *slot;
+    struct tmf882x_mode_app *app;
+
+    if (!verify_mode(self)) return 0;
+    app = member_of(self, struct tmf882x_mode_app, mode);
+
+    // Runs without the platform lock, only the claimed slot and pipe_msg
+    // are touched here. The IRQ thread never writes a claimed slot.
+    if (!app->volat_data.pipe_claimed || app->volat_data.pipe_decoded)
+        return 0;
+
+    slot = &app->volat_data.pipe[app->volat_data.pipe_tail % APP_PIPE_DEPTH];
+    app->volat_data.pipe_rc = decode_data_msg(app, &slot->i2c_msg,
+                                              &app->volat_data.pipe_msg);
+    app->volat_data.pipe_decoded = true;
+    return 1;
+}
+
+static int32_t tmf882x_mode_app_publish(struct tmf882x_mode *self)
+{
+    struct tmf882x_mode_app_pipe_slot *slot;
+    struct tmf882x_mode_app *app;
+    int32_t rc = 0;
+
+    if (!verify_mode(self)) return -1;
+    app = member_of(self, struct tmf882x_mode_app, mode);
+
+    if (app->volat_data.pipe_decoded) {
+        slot = &app->volat_data.pipe[app->volat_data.pipe_tail % APP_PIPE_DEPTH];
+        app->volat_data.pipe_decoded = false;
+        app->volat_data.pipe_claimed = false;
+        app->volat_data.pipe_tail++;
+
+        // drop frames decoded for a measurement that has since been stopped
+        if (slot->gen == app->volat_data.pipe_gen && is_measuring(app)) {
+            if (app->volat_data.pipe_rc) {
+                TOF_SET_ERR_MSG(&app->volat_data.pipe_msg, ERR_COMM);
+                rc = tof_queue_msg(priv(app), &app->volat_data.pipe_msg);
+            } else {
+                rc = publish_data_msg(app, &app->volat_data.pipe_msg,
+                                      &slot->ts, slot->timestamp_ns);
+            }
+        }
+    }
+
+    // hand the next pending frame to the decode worker
+    app->volat_data.pipe_claimed =
+        app->volat_data.pipe_head != app->volat_data.pipe_tail;
+    return rc;
+}
+
 static int32_t tmf882x_mode_app_i2c_msg_send_timeout(struct tmf882x_mode_app *app,
                                                      const struct tmf882x_mode_app_i2c_msg *i2c_msg,
                                                      uint32_t timeout_ms)
@@ -1186,7 +1394,7 @@ static int32_t tmf882x_mode_app_i2c_msg_send_timeout(struct tmf882x_mode_app *ap
     }
 
     // check that command status is successful
-    rc = check_cmd_status_timeout(app, timeout_ms);
+    rc = wait_cmd_done(app, timeout_ms);
     if (rc) {
         tof_err(priv(app), "Error (%d) timeout waiting for msg send complete",
                 rc);
@@ -1197,110 +1405,201 @@ static int32_t tmf882x_mode_app_i2c_msg_send_timeout(struct tmf882x_mode_app *ap
     return rc;
 }
 
-static int32_t tmf882x_mode_app_i2c_msg_recv(struct tmf882x_mode_app *app,
-                                             struct tmf882x_mode_app_i2c_msg *i2c_msg)
+static int32_t read_i2c_msg_burst(struct tmf882x_mode_app *app,
+                                  uint8_t *buf, size_t offset, size_t len)
 {
-    const uint8_t *head = NULL;
-    size_t payload_sz = TMF8X2X_COM_HEADER_PLUS_PAYLOAD;
-    int32_t rc = 0;
+    int32_t rc;
 
-    if (!i2c_msg) return -1;
+    // RID, TID, size and payload are one contiguous register window
+    rc = tof_i2c_read(priv(app), TMF8X2X_COM_CONFIG_RESULT + offset,
+                      &buf[offset], len);
+    if (rc) {
+        tof_err(priv(app), "Error: %d reading App i2c_msg packet", rc);
+        TOF_SET_ERR_MSG(to_msg(app), ERR_COMM);
+        tof_queue_msg(priv(app), to_msg(app));
+        return -1;
+    }
+    return 0;
+}
 
-    // if we are reading an irq message try to determine size from irq mask
-    if (app->volat_data.irq & F_RESULT_IRQ) {
-        payload_sz = TMF8X2X_COM_HEADER_PLUS_RESULT_PAYLOAD;
-    } else if (app->volat_data.irq & F_RAW_HIST_IRQ)  {
-        payload_sz = TMF8X2X_COM_HEADER_PLUS_HIST_PAYLOAD;
+static uint8_t i2c_msg_expected_rid(struct tmf882x_mode_app *app,
+                                    const struct tmf882x_mode_app_i2c_msg *i2c_msg)
+{
+    if (app->volat_data.irq & F_RESULT_IRQ)
+        return TMF8X2X_COM_CONFIG_RESULT__cid_rid__MEASUREMENT_RESULT;
+    if (app->volat_data.irq)
+        return app->volat_data.last_irq_rid;
+    // config page loads respond with the page CID equal to the command
+    return i2c_msg->cmd;
+}
+
+static size_t i2c_msg_read_hint(struct tmf882x_mode_app *app, uint8_t rid,
+                                size_t payload_sz)
+{
+    size_t hint = app->volat_data.rid_read_sz[rid];
+    // unknown RID: read just enough to decode the (sub)packet header
+    if (hint < APP_RECV_MIN_SIZE)
+        hint = APP_RECV_MIN_SIZE;
+    return ams_min(hint, payload_sz);
+}
+
+static size_t i2c_msg_payload_size(uint8_t rid)
+{
+    if (rid == TMF8X2X_COM_CONFIG_RESULT__cid_rid__MEASUREMENT_RESULT)
+        return TMF8X2X_COM_HEADER_PLUS_RESULT_PAYLOAD;
+    if (APP_RESP_IS_MULTI_PACKET(rid))
+        return TMF8X2X_COM_HEADER_PLUS_HIST_PAYLOAD;
+    return TMF8X2X_COM_HEADER_PLUS_PAYLOAD;
+}
+
+static int32_t read_i2c_msg_tail(struct tmf882x_mode_app *app,
+                                 struct tmf882x_mode_app_i2c_msg *i2c_msg,
+                                 uint8_t *buf, size_t read_sz,
+                                 size_t payload_sz)
+{
+    size_t pckt_sz = TMF8X2X_COM_HEADER_SIZE;
+
+    if (APP_RESP_IS_MULTI_PACKET(i2c_msg->rid))
+        pckt_sz += TMF8X2X_COM_OPTIONAL_SUBPACKET_HEADER_SIZE +
+                   i2c_msg->pckt_size;
+    else
+        pckt_sz += i2c_msg->size;
+    pckt_sz = ams_min(pckt_sz, payload_sz);
+
+    // remember the size so the next message of this RID is a single read
+    app->volat_data.rid_read_sz[i2c_msg->rid] = pckt_sz;
+    if (pckt_sz <= read_sz)
+        return 0;
+    return read_i2c_msg_burst(app, buf, read_sz, pckt_sz - read_sz);
+}
+
+#if (CONFIG_TMF882X_HISTOGRAM_SUPPORT())
+/**
+ * i2c_msg_recv_packet - receive the next sub-packet of a multi-packet message
+ *
+ * Returns APP_RECV_RESYNC with the first @read_sz bytes of a new message at
+ * the start of the @i2c_msg buffer if the device dropped a sub-packet,
+ * otherwise the same values as tmf882x_mode_app_i2c_msg_recv()
+ */
+static int32_t i2c_msg_recv_packet(struct tmf882x_mode_app *app,
+                                   struct tmf882x_mode_app_i2c_msg *i2c_msg,
+                                   size_t payload_sz, size_t *read_sz_out)
+{
+    uint8_t *buf = &i2c_msg->buf[app->volat_data.mp_data_read];
+    const uint8_t *head;
+    uint8_t rid = i2c_msg->rid;
+    uint8_t last_tid = i2c_msg->tid;
+    size_t read_sz;
+    int32_t rc;
+
+    read_sz = i2c_msg_read_hint(app, rid, payload_sz);
+    if (app->volat_data.mp_data_read + read_sz > sizeof(i2c_msg->buf)) {
+        tof_err(priv(app), "Error, multi-packet message exceeds %zu B",
+                sizeof(i2c_msg->buf));
+        app->volat_data.mp_pending = false;
+        return -1;
     }
 
-    rc = check_cmd_status(app, CMD_TIMEOUT_RETRIES);
+    rc = read_i2c_msg_burst(app, buf, 0, read_sz);
     if (rc) {
-        tof_err(priv(app), "Error, app CMD_STAT timeout");
-        tmf882x_force_stop(app); // force stop to get to stable state
+        app->volat_data.mp_pending = false;
         return rc;
     }
 
-    // make sure a new message has been published
-    rc = wait_for_tid_change(app);
-    if (rc) {
-        tof_dbg(priv(app), "warning: %d IRQ TID never changed", rc);
-        TOF_SET_ERR_MSG(to_msg(app), ERR_COMM);
-        tof_queue_msg(priv(app), to_msg(app));
-        return -2;
+    // the next sub-packet has not been published yet
+    if (buf[APP_COM_TID_IDX] == last_tid)
+        return APP_RECV_PENDING;
+
+    // a sub-packet was lost and the device published the next message,
+    // abandon the partial message and parse the new one
+    if (buf[APP_COM_RID_IDX] != rid) {
+        tof_err(priv(app), "Error, sub-packet RID %#x in message RID %#x",
+                buf[APP_COM_RID_IDX], rid);
+        app->volat_data.mp_pending = false;
+        app_memmove(i2c_msg->buf, buf, read_sz);
+        *read_sz_out = read_sz;
+        return APP_RECV_RESYNC;
     }
 
-    // Read i2c message
-    rc = tof_i2c_read(priv(app), TMF8X2X_COM_CONFIG_RESULT,
-                      i2c_msg->buf, payload_sz);
+    head = decode_i2c_msg_header(i2c_msg, buf, read_sz);
+    rc = read_i2c_msg_tail(app, i2c_msg, buf, read_sz, payload_sz);
     if (rc) {
-        tof_err(priv(app), "Error: %d reading App i2c_msg header", rc);
-        TOF_SET_ERR_MSG(to_msg(app), ERR_COMM);
-        tof_queue_msg(priv(app), to_msg(app));
-        return -1;
+        app->volat_data.mp_pending = false;
+        return rc;
     }
 
-    head = decode_i2c_msg_header(i2c_msg, i2c_msg->buf, payload_sz);
+    // throw away subpacket header by shifting down data
+    app_memmove(buf, head, i2c_msg->pckt_size);
+    app->volat_data.mp_data_read += i2c_msg->pckt_size;
+    if (app->volat_data.mp_data_read < i2c_msg->size)
+        return APP_RECV_PENDING;
+
+    tof_app_dbg(app, "app: multi-packet read complete - data_read: %u B",
+                app->volat_data.mp_data_read);
+    app->volat_data.mp_pending = false;
+    return 0;
+}
+
+static int32_t i2c_msg_poll_packets(struct tmf882x_mode_app *app,
+                                    struct tmf882x_mode_app_i2c_msg *i2c_msg,
+                                    size_t payload_sz, size_t *read_sz)
+{
+    uint32_t num_retries = MS_TIME_TO_POLLS(CMD_DEF_TIMEOUT_MS);
+    int32_t rc;
+
+    // no sub-packet IRQ to wait for, poll for the next packets instead
+    do {
+        tof_usleep(priv(app), APP_PACKET_POLL_US);
+        (void) tof_clear_irq(app);
+        rc = i2c_msg_recv_packet(app, i2c_msg, payload_sz, read_sz);
+        if (rc != APP_RECV_PENDING)
+            return rc;
+    } while (--num_retries);
+
+    tof_app_dbg(app, "multi-packet timeout after %u of %u B",
+                app->volat_data.mp_data_read, i2c_msg->size);
+    app->volat_data.mp_pending = false;
+    return -1;
+}
+#endif
+
+/**
+ * i2c_msg_parse_one - parse a message from the start of the @i2c_msg buffer
+ *
+ * The first @read_sz bytes have been read, the rest is read as needed. Same
+ * return values as i2c_msg_recv_packet()
+ */
+static int32_t i2c_msg_parse_one(struct tmf882x_mode_app *app,
+                                 struct tmf882x_mode_app_i2c_msg *i2c_msg,
+                                 size_t *read_sz, size_t payload_sz)
+{
+    const uint8_t *head;
+    int32_t rc;
+
+    head = decode_i2c_msg_header(i2c_msg, i2c_msg->buf, *read_sz);
     tof_app_dbg(app, "app: i2c_msg_recv - RID: %#x TID: %#x SIZE: %u B",
                 i2c_msg->rid, i2c_msg->tid, i2c_msg->size);
 
+    // the header tells the exact size, read what the hint did not cover
+    rc = read_i2c_msg_tail(app, i2c_msg, i2c_msg->buf, *read_sz, payload_sz);
+    if (rc) return rc;
+    if (app->volat_data.irq)
+        app->volat_data.last_irq_rid = i2c_msg->rid;
+
     if (APP_RESP_IS_MULTI_PACKET(i2c_msg->rid)) {
 
 #if (CONFIG_TMF882X_HISTOGRAM_SUPPORT())
-        uint8_t last_tid;
-        size_t data_read = 0;
-        uint32_t num_retries;
-        data_read = i2c_msg->pckt_size;
         // First packet is already read, throw out header by shifting data down
         app_memmove(i2c_msg->buf, head, i2c_msg->pckt_size);
-
-        while (data_read < i2c_msg->size) {
-
-            // clear subpacket irq
-            (void) tof_clear_irq(app);
-
-            num_retries = TID_CHANGE_RETRIES;
-            last_tid = i2c_msg->tid;
-
-            do {
-                // Read i2c data packet
-                rc = tof_i2c_read(priv(app),
-                                  TMF8X2X_COM_CONFIG_RESULT,
-                                  &i2c_msg->buf[data_read],
-                                  payload_sz);
-                if (rc) {
-                    tof_err(priv(app), "Error: %d reading App i2c_msg packet",
-                            rc);
-                    TOF_SET_ERR_MSG(to_msg(app), ERR_COMM);
-                    tof_queue_msg(priv(app), to_msg(app));
-                    return -1;
-                }
-
-                head = decode_i2c_msg_header(i2c_msg,
-                                             &i2c_msg->buf[data_read],
-                                             payload_sz);
-
-                // check TID
-                if (i2c_msg->tid == last_tid) {
-                    /* TID has not changed*/
-                    if (num_retries == 0) {
-                        tof_app_dbg(app, "TID did not change prev TID: %#x curr TID: %#x",
-                                    last_tid, i2c_msg->tid);
-                        return -1;
-                    }
-                    continue;
-                } else {
-                    break;
-                }
-            } while (--num_retries);
-
-            // throw away subpacket header by shifting down data
-            app_memmove(&i2c_msg->buf[data_read], head, i2c_msg->pckt_size);
-            data_read += i2c_msg->pckt_size;
-        }
-
-        tof_app_dbg(app, "app: multi-packet read complete - data_read: %zu B",
-                    data_read);
-
+        app->volat_data.mp_data_read = i2c_msg->pckt_size;
+        if (app->volat_data.mp_data_read >= i2c_msg->size)
+            return 0;
+
+        // the remaining sub-packets each raise their own IRQ
+        app->volat_data.mp_pending = true;
+        if (app->volat_data.irq && !tof_irq_is_polled(priv(app)))
+            return APP_RECV_PENDING;
+        return i2c_msg_poll_packets(app, i2c_msg, payload_sz, read_sz);
 #endif
     } else {
         // Single payload message has already been read,
@@ -1311,6 +1610,102 @@ static int32_t tmf882x_mode_app_i2c_msg_recv(struct tmf882x_mode_app *app,
     return 0;
 }
 
+/**
+ * i2c_msg_parse - parse messages until one is complete or pending
+ *
+ * A message abandoned for a lost sub-packet is followed by the message the
+ * device published instead, which is parsed with its own payload window.
+ * Same return values as tmf882x_mode_app_i2c_msg_recv()
+ */
+static int32_t i2c_msg_parse(struct tmf882x_mode_app *app,
+                             struct tmf882x_mode_app_i2c_msg *i2c_msg,
+                             size_t read_sz, size_t payload_sz)
+{
+    uint32_t resync = 0;
+    int32_t rc;
+
+    rc = i2c_msg_parse_one(app, i2c_msg, &read_sz, payload_sz);
+    while (rc == APP_RECV_RESYNC) {
+        if (++resync > APP_RECV_MAX_RESYNC) {
+            tof_err(priv(app), "Error, %u messages lost sub-packets", resync);
+            return -1;
+        }
+        payload_sz = i2c_msg_payload_size(i2c_msg->buf[APP_COM_RID_IDX]);
+        rc = i2c_msg_parse_one(app, i2c_msg, &read_sz, payload_sz);
+    }
+    return rc;
+}
+
+/**
+ * tmf882x_mode_app_i2c_msg_recv - receive a message from the device
+ *
+ * Returns 0 when a complete message is in @i2c_msg, APP_RECV_PENDING when a
+ * multi-packet message is waiting for its next sub-packet IRQ, or < 0 on
+ * error
+ */
+static int32_t tmf882x_mode_app_i2c_msg_recv(struct tmf882x_mode_app *app,
+                                             struct tmf882x_mode_app_i2c_msg *i2c_msg)
+{
+    size_t payload_sz = TMF8X2X_COM_HEADER_PLUS_PAYLOAD;
+    size_t read_sz;
+    int32_t rc = 0;
+
+    if (!i2c_msg) return -1;
+
+    // if we are reading an irq message try to determine size from irq mask
+    if (app->volat_data.irq & F_RESULT_IRQ) {
+        payload_sz = TMF8X2X_COM_HEADER_PLUS_RESULT_PAYLOAD;
+    } else if (app->volat_data.irq & F_RAW_HIST_IRQ)  {
+        payload_sz = TMF8X2X_COM_HEADER_PLUS_HIST_PAYLOAD;
+    }
+#if (CONFIG_TMF882X_HISTOGRAM_SUPPORT())
+    // IRQ for the next sub-packet of a partially received message, a
+    // synchronous response means the device dropped it
+    if (app->volat_data.mp_pending) {
+        if (app->volat_data.irq) {
+            rc = i2c_msg_recv_packet(app, i2c_msg, payload_sz, &read_sz);
+            if (rc != APP_RECV_RESYNC)
+                return rc;
+            payload_sz = i2c_msg_payload_size(i2c_msg->buf[APP_COM_RID_IDX]);
+            return i2c_msg_parse(app, i2c_msg, read_sz, payload_sz);
+        }
+        app->volat_data.mp_pending = false;
+    }
+#endif
+
+    read_sz = i2c_msg_read_hint(app, i2c_msg_expected_rid(app, i2c_msg),
+                                payload_sz);
+
+    // Read header and payload in one burst, a changed TID means the device
+    // has already published a new message
+    rc = read_i2c_msg_burst(app, i2c_msg->buf, 0, read_sz);
+    if (rc) return rc;
+
+    if (i2c_msg->buf[APP_COM_TID_IDX] == i2c_msg->tid) {
+        // device is not ready yet, fall back to wait for CMD_STAT and TID
+        rc = check_cmd_status(app, CMD_TIMEOUT_RETRIES);
+        if (rc) {
+            tof_err(priv(app), "Error, app CMD_STAT timeout");
+            tmf882x_force_stop(app); // force stop to get to stable state
+            return rc;
+        }
+
+        // make sure a new message has been published
+        rc = wait_for_tid_change(app);
+        if (rc) {
+            tof_dbg(priv(app), "warning: %d IRQ TID never changed", rc);
+            TOF_SET_ERR_MSG(to_msg(app), ERR_COMM);
+            tof_queue_msg(priv(app), to_msg(app));
+            return -2;
+        }
+
+        rc = read_i2c_msg_burst(app, i2c_msg->buf, 0, read_sz);
+        if (rc) return rc;
+    }
+
+    return i2c_msg_parse(app, i2c_msg, read_sz, payload_sz);
+}
+
 static int32_t send_breakpoint_continue_cmd(struct tmf882x_mode_app *app)
 {
     struct tmf882x_mode_app_i2c_msg *i2c_msg;
@@ -1336,14 +1731,14 @@ static int32_t decode_irq_msg(struct tmf882x_mode_app *app,
 
     switch(i2c_msg->rid) {
         case TMF8X2X_COM_CONFIG_RESULT__cid_rid__MEASUREMENT_RESULT:
-            rc = decode_result_msg(app, i2c_msg);
-            break;
 #if (CONFIG_TMF882X_HISTOGRAM_SUPPORT())
         case TMF8X2X_COM_RID_RAW_HISTOGRAM_24_BITS:
         case TMF8X2X_COM_RID_ELECTRICAL_CALIBRATION_24_BITS:
-            rc = decode_histogram_msg(app, i2c_msg);
-            break;
 #endif
+        case TMF8X2X_COM_CONFIG_RESULT__cid_rid__ACCUMULATED_HITS_RESULT:
+            // data messages are decoded and published off the IRQ thread
+            rc = app_pipe_push(app, i2c_msg);
+            break;
         case TMF8X2X_COM_RID_BREAKPOINT_HIT:
             if (i2c_msg->size) {
                 tof_info(priv(app), "app RID: %#x BREAKPOINT data size: %u B",
@@ -1359,9 +1754,6 @@ static int32_t decode_irq_msg(struct tmf882x_mode_app *app,
                 tmf882x_dump_data(to_parent(app), i2c_msg->buf, i2c_msg->size);
             }
             break;
-        case TMF8X2X_COM_CONFIG_RESULT__cid_rid__ACCUMULATED_HITS_RESULT:
-            rc = decode_meas_stats_msg(app, i2c_msg);
-            break;
         case 0:
             // Message RID '0' is not a valid message, and this IRQ does not
             // need any handling
@@ -1418,7 +1810,10 @@ static int32_t tmf882x_enable_interrupts(struct tmf882x_mode_app *app, uint32_t
     if (error) {
         return error;
     }
-    return tof_set_register(priv(app), TMF882X_INT_EN, reg);
+    error = tof_set_register(priv(app), TMF882X_INT_EN, reg);
+    if (!error && (flags & F_CMD_DONE_IRQ))
+        app->volat_data.cmd_irq_enabled = true;
+    return error;
 }
 
 static int32_t tmf882x_disable_interrupts(struct tmf882x_mode_app *app, uint32_t flags)
@@ -1433,6 +1828,8 @@ static int32_t tmf882x_disable_interrupts(struct tmf882x_mode_app *app, uint32_t
     if (error) {
         return error;
     }
+    if (flags & F_CMD_DONE_IRQ)
+        app->volat_data.cmd_irq_enabled = false;
     return tof_set_register(priv(app), TMF882X_INT_EN, reg);
 }
 
@@ -1444,6 +1841,8 @@ static void tmf882x_mode_app_close(struct tmf882x_mode *self)
     tof_info(priv(app), "%s", __func__);
     tmf882x_force_stop(app);
     (void) tmf882x_disable_interrupts(app, F_IRQ_ALL);
+    // let an in-flight decode finish before the mode state goes away
+    tof_decode_sync(priv(app));
     app->volat_data.is_open = false;
 }
 
@@ -1530,10 +1929,17 @@ static int32_t tmf882x_mode_app_handle_irq(struct tmf882x_mode *self)
     if (int_stat) {
         // All other IRQs are handled here
         rc = tmf882x_mode_app_i2c_msg_recv(app, i2c_msg);
+        if (rc == APP_RECV_PENDING) {
+            // decode once the last sub-packet has arrived
+            app->volat_data.irq = 0;
+            return 0;
+        }
         if (rc) {
             tof_err(priv(app), "Error (%d) receiving i2c message", rc);
             return rc;
         }
+        if (i2c_msg->rid == TMF8X2X_COM_CONFIG_RESULT__cid_rid__MEASUREMENT_RESULT)
+            tof_result_irq(priv(app));
         rc = decode_irq_msg(app, i2c_msg);
         if (rc) {
             tof_err(priv(app), "Error (%d) decoding i2c message", rc);
@@ -1701,7 +2107,11 @@ static int32_t tmf882x_mode_app_set_config(struct tmf882x_mode_app *app,
             return -1;
         }
 
-        update_each_config_setting(app, i2c_msg, cfg);
+        rc = update_each_config_setting(app, i2c_msg, cfg);
+        if (rc) {
+            tof_err(priv(app), "Error (%d) writing common config", rc);
+            return -1;
+        }
         i2c_msg->size=0; // registers are updated, just need to commit
 
     } else {
@@ -2343,6 +2753,8 @@ static int32_t tmf882x_mode_app_set_8x8_mode(struct tmf882x_mode_app *app, bool
                     TMF8X2X_COM_CMD_STAT__cmd_stat__CMD_SWITCH_TMF8821_MODE;
     i2c_msg->size = 0;
     rc = tmf882x_mode_app_i2c_msg_send_timeout(app, i2c_msg, CMD_DEF_TIMEOUT_MS);
+    // the mode switch resets the device, cached registers no longer hold
+    tof_regcache_drop(priv(app));
     if (rc) {
         tof_err(priv(app), "Error (%d) setting 8x8 mode to %u", rc, is_8x8);
         return -1;
@@ -2359,7 +2771,7 @@ static int32_t tmf882x_mode_app_set_8x8_mode(struct tmf882x_mode_app *app, bool
     /* Switching this mode is a device reset so re-configure the device */
     // Reset TIDs so we dont get out of sync
     app->volat_data.i2c_msg.tid = 0;
-    tmf882x_enable_interrupts(app, F_IRQ_ALL & ~F_CMD_DONE_IRQ);
+    tmf882x_enable_interrupts(app, F_IRQ_ALL);
     if (is_8x8) {
         // SPAD Map ID must be set to custom time-multiplexed mode for 8x8 mode
         app->volat_data.cfg.spad_map_id = TMF8X2X_COM_SPAD_MAP_ID__spad_map_id__user_defined_2;
@@ -2551,9 +2963,11 @@ static int32_t tmf882x_mode_app_open(struct tmf882x_mode *self)
     }
 
     tof_info(priv(app), "%s", __func__);
+    // decode worker may still be reading the pipeline of a previous session
+    tof_decode_sync(priv(app));
     memset(&app->volat_data, 0, sizeof(struct volat_data));
 
-    tmf882x_enable_interrupts(app, F_IRQ_ALL & ~F_CMD_DONE_IRQ);
+    tmf882x_enable_interrupts(app, F_IRQ_ALL);
     (void) tmf882x_mode_app_stop_measurements(self);
 
     // init clock correction context
@@ -2591,6 +3005,8 @@ static const struct mode_vtable ops = {
     .start = tmf882x_mode_app_start_measurements,
     .stop = tmf882x_mode_app_stop_measurements,
     .process_irq = tmf882x_mode_app_handle_irq,
+    .decode = tmf882x_mode_app_decode,
+    .publish = tmf882x_mode_app_publish,
     .ioctl = tmf882x_mode_app_ioctl,
     .close = tmf882x_mode_app_close,
 };
@@ -69,6 +69,18 @@ struct tmf882x_mode_app;
 #define APP_MAX_MSG_SIZE        TMF8X2X_COM_HEADER_PLUS_PAYLOAD
 #endif
 
+/** @brief
+ *      Number of possible return message IDs (RID)
+ */
+#define APP_NUM_RID             256
+
+/** @brief
+ *      Number of received data messages that can wait for the decode worker,
+ *      one sub-capture (results, two histogram sets and statistics). The IRQ
+ *      thread decodes in place instead of dropping once the pipe is full.
+ */
+#define APP_PIPE_DEPTH          4
+
 /**
  *  @enum tmf882x_mode_app_pckt_indices
  *  @brief
@@ -133,6 +145,26 @@ struct tmf882x_mode_app_i2c_msg {
     uint8_t buf[APP_MAX_MSG_SIZE];
 };
 
+/**
+ * @struct tmf882x_mode_app_pipe_slot
+ * @brief
+ *      Received data message waiting to be decoded off the IRQ thread
+ * @var tmf882x_mode_app_pipe_slot::i2c_msg
+ *      This member is the received i2c message
+ * @var tmf882x_mode_app_pipe_slot::ts
+ *      This member is the host time of the IRQ, used for clock correction
+ * @var tmf882x_mode_app_pipe_slot::timestamp_ns
+ *      This member is the platform timestamp of the IRQ for the output message
+ * @var tmf882x_mode_app_pipe_slot::gen
+ *      This member is the measurement generation the message belongs to
+ */
+struct tmf882x_mode_app_pipe_slot {
+    struct tmf882x_mode_app_i2c_msg i2c_msg;
+    struct timespec64 ts;
+    uint64_t timestamp_ns;
+    uint32_t gen;
+};
+
 /**
  * @struct tmf882x_mode_app
  * @brief
@@ -157,6 +189,42 @@ struct tmf882x_mode_app_i2c_msg {
  *      This member holds the OSC trim counter for how often to trim the OSC
  * @var tmf882x_mode_app::volat_data::irq
  *      This member is the cached IRQ status while servicing device interrupts
+ * @var tmf882x_mode_app::volat_data::cmd_irq_enabled
+ *      This member is whether the device raises CMD_DONE IRQs
+ * @var tmf882x_mode_app::volat_data::cmd_irq_armed
+ *      This member is whether the last command waits for its CMD_DONE IRQ
+ *      instead of polling CMD_STAT
+ * @var tmf882x_mode_app::volat_data::last_irq_rid
+ *      This member is the RID of the last message read on a non-result IRQ
+ * @var tmf882x_mode_app::volat_data::rid_read_sz
+ *      This member is the last packet size seen per RID, used to size the
+ *      next read of the same RID
+ * @var tmf882x_mode_app::volat_data::mp_pending
+ *      This member is whether a multi-packet message is partially received
+ *      in i2c_msg and waits for its next sub-packet
+ * @var tmf882x_mode_app::volat_data::mp_data_read
+ *      This member is the payload size of a multi-packet message received so
+ *      far
+ * @var tmf882x_mode_app::volat_data::pipe
+ *      This member is the ring of received data messages handed from the IRQ
+ *      thread to the decode worker
+ * @var tmf882x_mode_app::volat_data::pipe_head
+ *      This member is the number of messages pushed to the ring
+ * @var tmf882x_mode_app::volat_data::pipe_tail
+ *      This member is the number of messages published from the ring
+ * @var tmf882x_mode_app::volat_data::pipe_gen
+ *      This member is the measurement generation, incremented on every stop so
+ *      messages of a previous measurement are dropped
+ * @var tmf882x_mode_app::volat_data::pipe_claimed
+ *      This member is whether the oldest message in the ring is handed to the
+ *      decode worker
+ * @var tmf882x_mode_app::volat_data::pipe_decoded
+ *      This member is whether pipe_msg holds a decoded message waiting to be
+ *      published
+ * @var tmf882x_mode_app::volat_data::pipe_rc
+ *      This member is the decode result of pipe_msg
+ * @var tmf882x_mode_app::volat_data::pipe_msg
+ *      This member is the @ref tmf882x_msg output of the decode worker
  * @var tmf882x_mode_app::volat_data::cr
  *      This member tracks the clock correction data @ref struct tmf882x_clk_corr
  * @var tmf882x_mode_app::volat_data::msg
@@ -209,6 +277,28 @@ struct tmf882x_mode_app {
         // cached IRQ status
         uint32_t irq;
 
+        // command completion is signalled by CMD_DONE IRQ
+        bool cmd_irq_enabled;
+        bool cmd_irq_armed;
+
+        // read size hints per RID
+        uint8_t last_irq_rid;
+        uint16_t rid_read_sz[APP_NUM_RID];
+
+        // multi-packet message reassembly
+        bool mp_pending;
+        uint16_t mp_data_read;
+
+        // decode pipeline, IRQ thread pushes and decode worker pops
+        struct tmf882x_mode_app_pipe_slot pipe[APP_PIPE_DEPTH];
+        uint32_t pipe_head;
+        uint32_t pipe_tail;
+        uint32_t pipe_gen;
+        bool pipe_claimed;
+        bool pipe_decoded;
+        int32_t pipe_rc;
+        struct tmf882x_msg pipe_msg;
+
         // clock correction
         struct tmf882x_clk_corr clk_cr;
 
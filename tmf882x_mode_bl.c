@@ -116,8 +116,9 @@ int32_t tmf882x_mode_bl_read_status(struct tmf882x_mode_bl *bl,
         num_retries = BL_CMD_RETRIES_5MS;
     do {
         num_retries -= 1;
+        /* header and checksum of a data-less response in one read */
         error = tof_i2c_read(priv(bl), BL_REG_CMD_STATUS,
-                rbuf, BL_MSG_HEADER_SIZE);
+                rbuf, BL_CALC_RSP_SIZE(0));
         if (error)
             continue;
         if (BL_IS_CMD_BUSY(*status)) {
@@ -131,11 +132,13 @@ int32_t tmf882x_mode_bl_read_status(struct tmf882x_mode_bl *bl,
         }
         /* if we have reached here, the command has either succeeded or failed */
         if ( *rdata_size >= 0 ) {
-            /* read in data part and csum */
-            error = tof_i2c_read(priv(bl), BL_REG_CMD_STATUS,
-                    rbuf, BL_CALC_RSP_SIZE(*rdata_size));
-            if (error)
-                continue;
+            /* read in data part and csum, unless already read */
+            if (*rdata_size > 0) {
+                error = tof_i2c_read(priv(bl), BL_REG_CMD_STATUS,
+                        rbuf, BL_CALC_RSP_SIZE(*rdata_size));
+                if (error)
+                    continue;
+            }
             chksum = (uint8_t) ~tmf882x_calc_chksum(rbuf, BL_CALC_RSP_SIZE(*rdata_size));
             if ((chksum != BL_VALID_CHKSUM) && (num_retries <= 0)) {
                 tof_err(priv(bl),
@@ -150,6 +153,27 @@ int32_t tmf882x_mode_bl_read_status(struct tmf882x_mode_bl *bl,
     return error;
 }
 
+/**
+ * Wait for the bootloader to finish the last command with a single byte
+ * poll of CMD_STAT, the first poll happens without delay
+ * @return the final command status, or negative on failure/timeout
+ */
+static int32_t tmf882x_mode_bl_wait_ready(struct tmf882x_mode_bl *bl,
+                                          int32_t num_retries)
+{
+    uint8_t status;
+
+    do {
+        if (tof_get_register(priv(bl), BL_REG_CMD_STATUS, &status))
+            return -1;
+        if (!BL_IS_CMD_BUSY(status))
+            return status;
+        tof_usleep(priv(bl), BL_CMD_WAIT_USEC);
+    } while (--num_retries > 0);
+    tof_info(priv(bl), "bl mode is busy: %#04x", status);
+    return -1;
+}
+
 int32_t tmf882x_mode_bl_send_rcv_cmd(struct tmf882x_mode_bl *bl)
 {
     int32_t error = -1;
@@ -206,6 +230,8 @@ int32_t tmf882x_mode_bl_reset(struct tmf882x_mode_bl *bl)
                                       BL_CALC_CHKSUM_SIZE(cmd->size));
 
     error = tmf882x_mode_bl_send_cmd(bl);
+    // the device resets, cached registers no longer hold
+    tof_regcache_drop(priv(bl));
     if (error)
         return error;
     return 0;
@@ -222,6 +248,8 @@ int32_t tmf882x_mode_bl_ram_remap(struct tmf882x_mode_bl *bl)
                                       BL_CALC_CHKSUM_SIZE(cmd->size));
 
     error = tmf882x_mode_bl_send_cmd(bl);
+    // the device resets, cached registers no longer hold
+    tof_regcache_drop(priv(bl));
     if (error)
         return error;
     return 0;
@@ -239,6 +267,8 @@ int32_t tmf882x_mode_bl_rom_remap(struct tmf882x_mode_bl *bl)
             BL_CALC_CHKSUM_SIZE(cmd->size));
 
     error = tmf882x_mode_bl_send_cmd(bl);
+    // the device resets, cached registers no longer hold
+    tof_regcache_drop(priv(bl));
     if (error)
         return error;
     return 0;
@@ -290,30 +320,35 @@ int32_t tmf882x_mode_bl_write_ram(struct tmf882x_mode_bl *bl,
                               const uint8_t *buf, int32_t len)
 {
     struct tmf882x_mode_bl_write_ram_cmd *cmd = &(bl->bl_command.write_ram_cmd);
-    int32_t idx = 0;
     int32_t num = 0;
     uint8_t chunk_bytes = 0;
-    int32_t error = 0;
     int32_t rc;
     if (!verify_mode(&bl->mode)) return -1;
+    /* the previous command was waited for, skip the busy check */
     do {
         cmd->command = BL_CMD_WR_RAM;
         chunk_bytes = ((len - num) > BL_MAX_DATA_SZ) ?
             BL_MAX_DATA_SZ : (uint8_t) (len - num);
         cmd->size = chunk_bytes;
-        for(idx = 0; idx < cmd->size; idx++) {
-            cmd->data[idx] = buf[num + idx];
-        }
+        memcpy(cmd->data, &buf[num], chunk_bytes);
         /* add chksum to end */
         cmd->data[(uint8_t)cmd->size] =
             tmf882x_calc_chksum(get_bl_cmd_buf(bl),
                     BL_CALC_CHKSUM_SIZE(cmd->size));
-        rc = tmf882x_mode_bl_send_rcv_cmd(bl);
-        if (!rc)
-            num += chunk_bytes;
-        error = error ? error : (rc ? rc : 0);
-    } while ((num < len) && !rc);
-    return error;
+        rc = tof_i2c_write(priv(bl), BL_REG_CMD_STATUS, get_bl_cmd_buf(bl),
+                           BL_CALC_CMD_SIZE(chunk_bytes));
+        if (rc)
+            return rc;
+        /* WR_RAM has no response data, the status byte is all we need */
+        rc = tmf882x_mode_bl_wait_ready(bl, BL_CMD_RETRIES_5MS);
+        if (rc != BL_STAT_READY) {
+            tof_err(priv(bl), "Error writing RAM at offset %d, status: %d",
+                    num, rc);
+            return -1;
+        }
+        num += chunk_bytes;
+    } while (num < len);
+    return 0;
 }
 
 int32_t tmf882x_mode_bl_upload_init(struct tmf882x_mode_bl *bl,
@@ -337,6 +372,7 @@ static int32_t hex_fwdl(struct tmf882x_mode_bl *bl, const uint8_t *buf, size_t l
     int32_t error;
     uint32_t patch_size = 0;
     uint32_t addr = 0;
+    uint32_t next_addr = 0;
     uint8_t bin[BL_MAX_DATA_SZ];
     tof_info(priv(bl), "Starting HEX fwdl");
     ihexi_init(&bl->hex, buf, len);
@@ -350,17 +386,21 @@ static int32_t hex_fwdl(struct tmf882x_mode_bl *bl, const uint8_t *buf, size_t l
             return size;
         }
 
+        // WR_RAM auto-increments, only set the address on a discontinuity
+        if (!patch_size || addr != next_addr) {
+            error = tmf882x_mode_bl_addr_ram(bl, addr);
+            if (error) {
+                tmf882x_dump_i2c_regs(to_parent(bl));
+                tof_info(priv(bl), "Error setting start addr %#x: \'%d\'",
+                         addr, error);
+                return error;
+            }
+        }
+        next_addr = addr + size;
+
         // add up patch size
         patch_size += size;
 
-        error = tmf882x_mode_bl_addr_ram(bl, addr);
-        if (error) {
-            tmf882x_dump_i2c_regs(to_parent(bl));
-            tof_info(priv(bl), "Error setting start addr %#x: \'%d\'",
-                     addr, error);
-            return error;
-        }
-
         error = tmf882x_mode_bl_write_ram(bl, bin, size);
         if (error) {
             tof_info(priv(bl), "Error writing RAM: \'%d\'", error);
@@ -390,6 +430,138 @@ static int32_t hex_fwdl(struct tmf882x_mode_bl *bl, const uint8_t *buf, size_t l
 }
 #endif
 
+uint32_t tmf882x_mode_bl_crc32(const uint8_t *buf, size_t len)
+{
+    // nibble table for the reflected polynomial 0xEDB88320
+    static const uint32_t crc_tbl[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+        0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    uint32_t crc = ~0U;
+    while (len--) {
+        crc = crc_tbl[(crc ^ *buf) & 0xF] ^ (crc >> 4);
+        crc = crc_tbl[(crc ^ (*buf++ >> 4)) & 0xF] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+#if (CONFIG_TMF882X_INTELHEX_SUPPORT())
+static void seg_close(uint8_t *seg, uint32_t addr, uint32_t len)
+{
+    struct tmf882x_fw_seg *hdr = (struct tmf882x_fw_seg *)seg;
+    uint8_t *data = (uint8_t *)(hdr + 1);
+    hdr->addr = addr;
+    hdr->len = len;
+    hdr->crc = tmf882x_mode_bl_crc32(data, len);
+    // keep the padding deterministic
+    memset(&data[len], 0, BL_SEG_SIZE(len) - sizeof(*hdr) - len);
+}
+#endif
+
+int32_t tmf882x_mode_bl_hex_to_seg(const uint8_t *hex, size_t hex_len,
+                                   uint8_t *seg, size_t seg_len)
+{
+#if (CONFIG_TMF882X_INTELHEX_SUPPORT())
+    struct intel_hex_interpreter ihex;
+    uint8_t bin[BL_MAX_DATA_SZ];
+    uint32_t addr = 0;
+    uint32_t seg_addr = 0;
+    uint32_t seg_bytes = 0;
+    size_t off = 0;
+    int32_t size;
+
+    ihexi_init(&ihex, hex, hex_len);
+    while ( (size = ihexi_get_next_bin(&ihex, bin, sizeof(bin), &addr)) ) {
+        if (size < 0)
+            return size;
+        // start a new segment on any address discontinuity
+        if (!seg_bytes || addr != seg_addr + seg_bytes) {
+            if (seg_bytes) {
+                if (seg)
+                    seg_close(&seg[off], seg_addr, seg_bytes);
+                off += BL_SEG_SIZE(seg_bytes);
+            }
+            seg_addr = addr;
+            seg_bytes = 0;
+        }
+        if (seg) {
+            if (off + BL_SEG_SIZE(seg_bytes + size) > seg_len)
+                return -1;
+            memcpy(&seg[off + sizeof(struct tmf882x_fw_seg) + seg_bytes],
+                   bin, size);
+        }
+        seg_bytes += size;
+    }
+
+    // a partial image can not be downloaded on its own
+    if (!ihexi_is_eof(&ihex) || !seg_bytes)
+        return -1;
+    if (seg)
+        seg_close(&seg[off], seg_addr, seg_bytes);
+    return off + BL_SEG_SIZE(seg_bytes);
+#else
+    return -1;
+#endif
+}
+
+static int32_t seg_fwdl(struct tmf882x_mode_bl *bl, const uint8_t *buf, size_t len)
+{
+    const struct tmf882x_fw_seg *hdr;
+    const uint8_t *data;
+    uint32_t patch_size = 0;
+    uint32_t num_seg = 0;
+    size_t off = 0;
+    int32_t error;
+    tof_info(priv(bl), "Starting SEG fwdl");
+
+    while (off + sizeof(*hdr) <= len) {
+        hdr = (const struct tmf882x_fw_seg *)&buf[off];
+        data = (const uint8_t *)(hdr + 1);
+        if (off + BL_SEG_SIZE(hdr->len) > len) {
+            tof_err(priv(bl), "%s: truncated segment at %zu", __func__, off);
+            return -1;
+        }
+        if (tmf882x_mode_bl_crc32(data, hdr->len) != hdr->crc) {
+            tof_err(priv(bl), "%s: CRC mismatch in segment %#x",
+                    __func__, hdr->addr);
+            return -1;
+        }
+
+        // one RAM_ADDR per segment, WR_RAM auto-increments the address
+        error = tmf882x_mode_bl_addr_ram(bl, hdr->addr);
+        if (error) {
+            tmf882x_dump_i2c_regs(to_parent(bl));
+            tof_info(priv(bl), "Error setting start addr %#x: \'%d\'",
+                     hdr->addr, error);
+            return error;
+        }
+
+        error = tmf882x_mode_bl_write_ram(bl, data, hdr->len);
+        if (error) {
+            tof_info(priv(bl), "Error writing RAM: \'%d\'", error);
+            tmf882x_dump_i2c_regs(to_parent(bl));
+            return error;
+        }
+
+        patch_size += hdr->len;
+        num_seg++;
+        off += BL_SEG_SIZE(hdr->len);
+    }
+
+    tof_info(priv(bl), "%s: patch size: %u B in %u segments", __func__,
+             patch_size, num_seg);
+
+    error = tmf882x_mode_bl_ram_remap(bl);
+    if (error) {
+        tmf882x_dump_i2c_regs(to_parent(bl));
+        tof_info(priv(bl), "Error RAM REMAPRESET command: \'%d\'", error);
+        return error;
+    }
+    return 0;
+}
+
 static int32_t bin_fwdl(struct tmf882x_mode_bl *bl, const uint8_t *buf, size_t len)
 {
     int32_t error = 0;
@@ -462,6 +634,9 @@ static int32_t tmf882x_mode_bl_fwdl(struct tmf882x_mode *self, int32_t fwdl_type
         case FWDL_TYPE_BIN:
             rc = bin_fwdl(bl, buf, len);
             break;
+        case FWDL_TYPE_SEG:
+            rc = seg_fwdl(bl, buf, len);
+            break;
         default:
             tof_err(priv(bl), "Error invalid fwdl_type: \'%u\'", fwdl_type);
             return rc;
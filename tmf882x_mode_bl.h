@@ -221,6 +221,24 @@ union tmf882x_mode_bl_command {
     struct tmf882x_mode_bl_short_cmd       short_cmd;
 };
 
+/**
+ * This is the header of one segment of a pre-converted firmware image
+ * (@ref FWDL_TYPE_SEG). A segment holds one contiguous run of RAM data, the
+ * data follows the header and the next header starts at the next 4-byte
+ * boundary.
+ */
+struct tmf882x_fw_seg {
+    /** This member is the RAM address of the segment data */
+    uint32_t addr;
+    /** This member is the number of segment data bytes */
+    uint32_t len;
+    /** This member is the CRC-32 of the segment data */
+    uint32_t crc;
+};
+
+#define BL_SEG_SIZE(len)    (sizeof(struct tmf882x_fw_seg) + \
+                             (((len) + 3) & ~3U))
+
 /**
  * This is the Bootloader mode context structure
  */
@@ -263,6 +281,36 @@ struct tmf882x_mode_bl {
  */
 extern void tmf882x_mode_bl_init(struct tmf882x_mode_bl *bl, void *priv);
 
+/**
+ * Convert a complete Intel Hex image into @ref tmf882x_fw_seg segments that
+ * can be downloaded with @ref FWDL_TYPE_SEG without parsing. Records with
+ * continuous addresses are coalesced into one segment.
+ * @param[in] hex
+ *      pointer to the Intel Hex records
+ * @param[in] hex_len
+ *      size of the Intel Hex records
+ * @param[out] seg
+ *      output buffer for the segments, NULL to only calculate the size
+ * @param[in] seg_len
+ *      size of the output buffer
+ * @return
+ *      size of the converted image, negative if the image is invalid,
+ *      incomplete or does not fit into the output buffer
+ */
+extern int32_t tmf882x_mode_bl_hex_to_seg(const uint8_t *hex, size_t hex_len,
+                                          uint8_t *seg, size_t seg_len);
+
+/**
+ * Calculate the CRC-32 (IEEE 802.3) of a buffer
+ * @param[in] buf
+ *      pointer to the data
+ * @param[in] len
+ *      number of data bytes
+ * @return
+ *      CRC-32 of the data
+ */
+extern uint32_t tmf882x_mode_bl_crc32(const uint8_t *buf, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -66,13 +66,18 @@ static inline int32_t tof_i2c_write(struct tof_sensor_chip *chip, uint8_t reg,
 static inline int32_t tof_set_register(struct tof_sensor_chip *chip, uint8_t reg,
                                        uint8_t val)
 {
-    return tof_frwk_i2c_write(chip, reg, &val, 1);
+    return tof_frwk_reg_write(chip, reg, val);
 }
 
 static inline int32_t tof_get_register(struct tof_sensor_chip *chip, uint8_t reg,
                                        uint8_t *val)
 {
-    return tof_frwk_i2c_read(chip, reg, val, 1);
+    return tof_frwk_reg_read(chip, reg, val);
+}
+
+static inline void tof_regcache_drop(struct tof_sensor_chip *chip)
+{
+    tof_frwk_regcache_drop(chip);
 }
 
 static inline void tof_usleep(struct tof_sensor_chip *chip, uint32_t usec)
@@ -85,9 +90,71 @@ static inline int32_t tof_queue_msg(struct tof_sensor_chip *chip, struct tmf882x
     return tof_frwk_queue_msg(chip, msg);
 }
 
+static inline int32_t tof_queue_msg_at(struct tof_sensor_chip *chip,
+                                       struct tmf882x_msg *msg,
+                                       uint64_t timestamp_ns)
+{
+    return tof_frwk_queue_msg_at(chip, msg, timestamp_ns);
+}
+
+static inline uint64_t tof_get_irq_timestamp(struct tof_sensor_chip *chip)
+{
+    return tof_frwk_irq_timestamp(chip);
+}
+
+static inline int32_t tof_schedule_decode(struct tof_sensor_chip *chip)
+{
+    return tof_frwk_schedule_decode(chip);
+}
+
+static inline void tof_decode_sync(struct tof_sensor_chip *chip)
+{
+    tof_frwk_decode_sync(chip);
+}
+
+static inline void tof_result_irq(struct tof_sensor_chip *chip)
+{
+    tof_frwk_result_irq(chip);
+}
+
+static inline void tof_poll_reset(struct tof_sensor_chip *chip, bool stats)
+{
+    tof_frwk_poll_reset(chip, stats);
+}
+
+static inline bool tof_irq_is_polled(struct tof_sensor_chip *chip)
+{
+    return tof_frwk_irq_is_polled(chip);
+}
+
+static inline int32_t tof_cmd_irq_arm(struct tof_sensor_chip *chip)
+{
+    return tof_frwk_cmd_irq_arm(chip);
+}
+
+static inline bool tof_irq_thread_pending(struct tof_sensor_chip *chip)
+{
+    return tof_frwk_irq_thread_pending(chip);
+}
+
+static inline int32_t tof_cmd_irq_wait(struct tof_sensor_chip *chip, uint32_t usec)
+{
+    return tof_frwk_cmd_irq_wait(chip, usec);
+}
+
+static inline void tof_cmd_irq_disarm(struct tof_sensor_chip *chip)
+{
+    tof_frwk_cmd_irq_disarm(chip);
+}
+
 static inline void tof_get_timespec(struct timespec64 *ts)
 {
     ktime_get_real_ts64(ts);
 }
 
+static inline uint64_t tof_get_time_us(void)
+{
+    return ktime_to_us(ktime_get());
+}
+
 #endif